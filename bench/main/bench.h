@@ -0,0 +1,53 @@
+/**
+ * @file bench.h
+ *
+ * Benchmarks of the SHT4x driver on a linux target.
+ *
+ * Each benchmark prints one JSON object per line.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/** Monotonic time (ns). */
+static inline int64_t bench_time_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/** CPU cycle counter, or 0 if not available. */
+static inline uint64_t bench_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/** Benchmark CRC-8 implementations. */
+void bench_crc(void);
+
+/** Benchmark batch conversion of raw data. */
+void bench_convert(void);
+
+/** Benchmark dew point, absolute humidity and vapor pressure deficit. */
+void bench_humidity(void);
+
+/** Benchmark throughput and latency of measurements of a simulated sensor. */
+void bench_measure(void);
+
+/** Benchmark retry overhead with injected CRC errors. */
+void bench_retry(void);
+
+/** Benchmark scheduler sweeps over 1 to 8 simulated sensors. */
+void bench_sweep(void);
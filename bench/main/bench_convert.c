@@ -0,0 +1,78 @@
+/**
+ * @file bench_convert.c
+ *
+ * Benchmark batch conversion of raw sensor data.
+ */
+
+#include "bench.h"
+#include "sht4x_convert.h"
+
+#include <stdio.h>
+
+#define NUM_SAMPLES 4096
+#define NUM_ROUNDS 2000
+
+static uint16_t t_raw[NUM_SAMPLES], rh_raw[NUM_SAMPLES];
+static float t_float[NUM_SAMPLES], rh_float[NUM_SAMPLES];
+static int32_t t_fixed[NUM_SAMPLES], rh_fixed[NUM_SAMPLES];
+
+/** Per-sample conversion in double precision (as done by sht4x_measure()). */
+static void convert_scalar(void)
+{
+    for (int i = 0; i < NUM_SAMPLES; ++i) {
+        float rh = -6.0 + 125.0 * rh_raw[i] / 65535.0;
+
+        t_float[i] = -45.0 + 175.0 * t_raw[i] / 65535.0;
+        rh_float[i] = (rh > 100.0f) ? 100.0f : (rh < 0.0f) ? 0.0f : rh;
+    }
+}
+
+static void convert_float(void)
+{
+    sht4x_convert(t_raw, rh_raw, NUM_SAMPLES, t_float, rh_float);
+}
+
+static void convert_fixed(void)
+{
+    sht4x_convert_fixed(t_raw, rh_raw, NUM_SAMPLES, t_fixed, rh_fixed);
+}
+
+static const struct {
+    const char *name;
+    void (*convert)(void);
+} impls[] = {
+    {"scalar_double", convert_scalar},
+    {"batch_float", convert_float},
+    {"batch_fixed", convert_fixed},
+};
+
+void bench_convert(void)
+{
+    const double n = (double)NUM_ROUNDS * NUM_SAMPLES;
+    uint32_t x = 0x9e3779b9;
+
+    for (int i = 0; i < NUM_SAMPLES; ++i) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+
+        t_raw[i] = x >> 16;
+        rh_raw[i] = x;
+    }
+
+    for (size_t k = 0; k < sizeof(impls) / sizeof(impls[0]); ++k) {
+        int64_t t0, t1;
+
+        t0 = bench_time_ns();
+
+        for (int r = 0; r < NUM_ROUNDS; ++r) {
+            impls[k].convert();
+        }
+
+        t1 = bench_time_ns();
+
+        printf("{\"bench\": \"convert\", \"impl\": \"%s\", \"ns_per_sample\": %.3f, "
+               "\"samples_per_s\": %.0f}\n",
+               impls[k].name, (t1 - t0) / n, n * 1e9 / (t1 - t0));
+    }
+}
@@ -0,0 +1,79 @@
+/**
+ * @file bench_crc.c
+ *
+ * Benchmark CRC-8 implementations on 6-byte sensor responses.
+ */
+
+#include "bench.h"
+#include "sht4x_crc.h"
+
+#include <stdio.h>
+
+#define NUM_RESPONSES 256
+#define NUM_ROUNDS 4000
+
+typedef uint8_t (*crc8_fn)(const uint8_t *data, size_t len);
+
+static const struct {
+    const char *name;
+    crc8_fn crc8;
+    unsigned table_size;
+} impls[] = {
+    {"bitwise", sht4x_crc8_bitwise, 0},
+    {"nibble", sht4x_crc8_nibble, 16},
+    {"table", sht4x_crc8_table, 256},
+};
+
+static uint8_t responses[NUM_RESPONSES][6];
+
+/** Fill `responses` with pseudo-random data and valid checksums. */
+static void make_responses(void)
+{
+    uint32_t x = 0x12345678;
+
+    for (int i = 0; i < NUM_RESPONSES; ++i) {
+        for (int k = 0; k < 6; k += 3) {
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+
+            responses[i][k] = x >> 8;
+            responses[i][k + 1] = x;
+            responses[i][k + 2] = sht4x_crc8_bitwise(&responses[i][k], 2);
+        }
+    }
+}
+
+void bench_crc(void)
+{
+    const double n = (double)NUM_ROUNDS * NUM_RESPONSES;
+
+    make_responses();
+
+    for (size_t k = 0; k < sizeof(impls) / sizeof(impls[0]); ++k) {
+        crc8_fn crc8 = impls[k].crc8;
+        volatile uint32_t num_valid = 0;
+        int64_t t0, t1;
+        uint64_t c0, c1;
+
+        t0 = bench_time_ns();
+        c0 = bench_cycles();
+
+        for (int r = 0; r < NUM_ROUNDS; ++r) {
+            for (int i = 0; i < NUM_RESPONSES; ++i) {
+                const uint8_t *data = responses[i];
+
+                num_valid += (crc8(data, 2) == data[2]) && (crc8(&data[3], 2) == data[5]);
+            }
+        }
+
+        c1 = bench_cycles();
+        t1 = bench_time_ns();
+
+        printf("{\"bench\": \"crc8\", \"impl\": \"%s\", \"table_bytes\": %u, "
+               "\"ns_per_response\": %.2f, \"cycles_per_response\": %.1f, "
+               "\"valid\": %s}\n",
+               impls[k].name, impls[k].table_size, (t1 - t0) / n, (c1 - c0) / n,
+               (num_valid == n) ? "true" : "false");
+    }
+}
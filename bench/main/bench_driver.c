@@ -0,0 +1,205 @@
+/**
+ * @file bench_driver.c
+ *
+ * Benchmark measurements of simulated sensors.
+ *
+ * Latencies include the conversion time of the simulated sensor
+ * (8.3 ms, 4.5 ms and 1.6 ms at high, medium and low precision);
+ * `overhead_us` is the mean latency beyond it.
+ */
+
+#include "bench.h"
+#include "sht4x.h"
+#include "sht4x_sched.h"
+#include "sht4x_sim.h"
+#include "driver/mock_i2c.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define PORT I2C_NUM_0
+#define NUM_SAMPLES 100
+#define NUM_SWEEPS 10
+
+#if CONFIG_SHT4X_WAIT_TICK
+#define WAIT "tick"
+#elif CONFIG_SHT4X_WAIT_POLL
+#define WAIT "poll"
+#else
+#define WAIT "timer"
+#endif
+
+static const sht4x_sim_config_t SIM_CONFIG = {
+    .serial = 0xdeadbeef,
+    .temperature = 20.0f,
+    .humidity = 40.0f,
+};
+
+static const struct {
+    const char *name;
+    sht4x_precision_t precision;
+    int64_t conversion_ns;
+} precisions[] = {
+    {"high", SHT4X_PRECISION_HIGH, 8300000},
+    {"medium", SHT4X_PRECISION_MEDIUM, 4500000},
+    {"low", SHT4X_PRECISION_LOW, 1600000},
+};
+
+static int64_t latency[NUM_SAMPLES];
+
+static int compare(const void *a, const void *b)
+{
+    const int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+/** Start simulator with one sensor and return its handle. */
+static sht4x_t sim_sensor(const sht4x_sim_config_t *config)
+{
+    sht4x_t sht4x;
+
+    mock_i2c_Init();
+    sht4x_sim_start(1);
+    ESP_ERROR_CHECK(sht4x_sim_add(PORT, CONFIG_SHT4X_ADDRESS, config));
+    ESP_ERROR_CHECK(sht4x_init(PORT, CONFIG_SHT4X_ADDRESS, &sht4x));
+
+    return sht4x;
+}
+
+static void sim_end(void)
+{
+    sht4x_sim_stop();
+    mock_i2c_Destroy();
+}
+
+/**
+ * Measure NUM_SAMPLES times; store latencies (sorted) in `latency`.
+ *
+ * @return Number of failed measurements.
+ */
+static int measure(sht4x_t sht4x, int64_t *total)
+{
+    uint32_t temp, rh;
+    int num_errors = 0;
+    int64_t t0 = bench_time_ns();
+
+    for (int i = 0; i < NUM_SAMPLES; ++i) {
+        const int64_t start = bench_time_ns();
+
+        num_errors += sht4x_measure_raw(sht4x, &temp, &rh) != ESP_OK;
+        latency[i] = bench_time_ns() - start;
+    }
+
+    *total = bench_time_ns() - t0;
+    qsort(latency, NUM_SAMPLES, sizeof(latency[0]), compare);
+
+    return num_errors;
+}
+
+/** Print latency distribution (us) as JSON members. */
+static void print_latency(void)
+{
+    printf("\"latency_us\": {\"min\": %.1f, \"p50\": %.1f, \"p90\": %.1f, "
+           "\"p99\": %.1f, \"max\": %.1f}",
+           latency[0] / 1e3, latency[NUM_SAMPLES / 2] / 1e3,
+           latency[NUM_SAMPLES * 9 / 10] / 1e3, latency[NUM_SAMPLES * 99 / 100] / 1e3,
+           latency[NUM_SAMPLES - 1] / 1e3);
+}
+
+void bench_measure(void)
+{
+    for (size_t k = 0; k < sizeof(precisions) / sizeof(precisions[0]); ++k) {
+        sht4x_t sht4x = sim_sensor(&SIM_CONFIG);
+        int64_t total;
+
+        ESP_ERROR_CHECK(sht4x_set_precision(sht4x, precisions[k].precision));
+        measure(sht4x, &total);
+
+        printf("{\"bench\": \"measure\", \"wait\": \"%s\", \"precision\": \"%s\", "
+               "\"samples_per_s\": %.1f, \"overhead_us\": %.1f, ",
+               WAIT, precisions[k].name, NUM_SAMPLES * 1e9 / total,
+               ((double)total / NUM_SAMPLES - precisions[k].conversion_ns) / 1e3);
+        print_latency();
+        printf("}\n");
+
+        sht4x_delete(sht4x);
+        sim_end();
+    }
+}
+
+void bench_retry(void)
+{
+    const float rates[] = {0.0f, 0.05f, 0.2f};
+
+    for (size_t k = 0; k < sizeof(rates) / sizeof(rates[0]); ++k) {
+        sht4x_sim_config_t config = SIM_CONFIG;
+        sht4x_sim_stats_t stats;
+        sht4x_t sht4x = sim_sensor(&config);
+        int64_t total;
+        int num_errors;
+
+        // inject errors after initialization
+        config.crc_error_rate = rates[k];
+        sht4x_sim_start(k + 1);
+        ESP_ERROR_CHECK(sht4x_sim_add(PORT, CONFIG_SHT4X_ADDRESS, &config));
+
+        num_errors = measure(sht4x, &total);
+        ESP_ERROR_CHECK(sht4x_sim_get_stats(PORT, CONFIG_SHT4X_ADDRESS, &stats));
+
+        printf("{\"bench\": \"retry\", \"wait\": \"%s\", \"crc_error_rate\": %.2f, "
+               "\"crc_errors\": %" PRIu32 ", \"failed\": %d, \"overhead_us\": %.1f, ",
+               WAIT, rates[k], stats.crc_errors, num_errors,
+               ((double)total / NUM_SAMPLES - precisions[0].conversion_ns) / 1e3);
+        print_latency();
+        printf("}\n");
+
+        sht4x_delete(sht4x);
+        sim_end();
+    }
+}
+
+void bench_sweep(void)
+{
+    sht4x_sched_result_t results[SHT4X_SIM_MAX_SENSORS];
+    sht4x_t handles[SHT4X_SIM_MAX_SENSORS];
+    uint32_t temp, rh;
+
+    for (int n = 1; n <= SHT4X_SIM_MAX_SENSORS; n *= 2) {
+        sht4x_sched_t sched;
+        int64_t t0, t1, t2;
+
+        mock_i2c_Init();
+        sht4x_sim_start(1);
+        ESP_ERROR_CHECK(sht4x_sched_create(n, &sched));
+
+        for (int i = 0; i < n; ++i) {
+            ESP_ERROR_CHECK(sht4x_sim_add(PORT, 0x44 + i, &SIM_CONFIG));
+            ESP_ERROR_CHECK(sht4x_init(PORT, 0x44 + i, &handles[i]));
+            ESP_ERROR_CHECK(sht4x_sched_add(sched, handles[i]));
+        }
+
+        t0 = bench_time_ns();
+
+        for (int r = 0; r < NUM_SWEEPS; ++r) {
+            ESP_ERROR_CHECK(sht4x_sched_sweep(sched, results));
+        }
+
+        t1 = bench_time_ns();
+
+        for (int r = 0; r < NUM_SWEEPS; ++r) {
+            for (int i = 0; i < n; ++i) {
+                ESP_ERROR_CHECK(sht4x_measure_raw(handles[i], &temp, &rh));
+            }
+        }
+
+        t2 = bench_time_ns();
+
+        printf("{\"bench\": \"sweep\", \"wait\": \"%s\", \"sensors\": %d, "
+               "\"sweep_us\": %.1f, \"sequential_us\": %.1f}\n",
+               WAIT, n, (t1 - t0) / 1e3 / NUM_SWEEPS, (t2 - t1) / 1e3 / NUM_SWEEPS);
+
+        sht4x_sched_delete(sched);
+        sim_end();
+    }
+}
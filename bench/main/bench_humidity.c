@@ -0,0 +1,123 @@
+/**
+ * @file bench_humidity.c
+ *
+ * Benchmark dew point, absolute humidity and vapor pressure deficit.
+ */
+
+#include "bench.h"
+#include "sht4x_convert.h"
+#include "sht4x_humidity.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#define NUM_SAMPLES 4096
+#define NUM_ROUNDS 200
+
+static uint16_t t_raw[NUM_SAMPLES], rh_raw[NUM_SAMPLES];
+static float t_float[NUM_SAMPLES], rh_float[NUM_SAMPLES];
+static float dp_float[NUM_SAMPLES], ah_float[NUM_SAMPLES], vpd_float[NUM_SAMPLES];
+static int32_t dp_fixed[NUM_SAMPLES], ah_fixed[NUM_SAMPLES], vpd_fixed[NUM_SAMPLES];
+
+/** Per-sample Magnus formula with logf() and expf(). */
+static void derive_libm(void)
+{
+    for (int i = 0; i < NUM_SAMPLES; ++i) {
+        float t = t_float[i], rh = (rh_float[i] < 1.0f) ? 1.0f : rh_float[i];
+        float x = 17.62f * t / (243.12f + t);
+        float g = logf(rh / 100.0f) + x;
+        float es = 611.2f * expf(x);
+        float e = rh / 100.0f * es;
+
+        dp_float[i] = 243.12f * g / (17.62f - g);
+        ah_float[i] = 2.167f * e / (273.15f + t);
+        vpd_float[i] = (es - e) / 1000.0f;
+    }
+}
+
+static void derive_float(void)
+{
+    sht4x_derive(t_float, rh_float, NUM_SAMPLES, dp_float, ah_float, vpd_float);
+}
+
+static void derive_fixed(void)
+{
+    sht4x_derive_fixed(t_raw, rh_raw, NUM_SAMPLES, dp_fixed, ah_fixed, vpd_fixed);
+}
+
+static const struct {
+    const char *name;
+    void (*derive)(void);
+    bool fixed;
+} impls[] = {
+    {"libm_float", derive_libm, false},
+    {"batch_float", derive_float, false},
+    {"batch_fixed", derive_fixed, true},
+};
+
+/** Max. error of the last derivation against the double precision formula. */
+static void max_error(bool fixed, double *dp_error, double *ah_error, double *vpd_error)
+{
+    *dp_error = *ah_error = *vpd_error = 0.0;
+
+    for (int i = 0; i < NUM_SAMPLES; ++i) {
+        double t = -45.0 + 175.0 * t_raw[i] / 65535.0;
+        double rh = fmax(-6.0 + 125.0 * rh_raw[i] / 65535.0, 1.0);
+        double x = 17.62 * t / (243.12 + t);
+        double g = log(rh / 100.0) + x;
+        double es = 611.2 * exp(x);
+        double e = rh / 100.0 * es;
+        double dp = 243.12 * g / (17.62 - g);
+        double ah = 2.167 * e / (273.15 + t);
+        double vpd = (es - e) / 1000.0;
+
+        if (fixed) {
+            *dp_error = fmax(*dp_error, fabs(dp_fixed[i] / 1000.0 - dp));
+            *ah_error = fmax(*ah_error, fabs(ah_fixed[i] / 1000.0 - ah));
+            *vpd_error = fmax(*vpd_error, fabs(vpd_fixed[i] / 1000.0 - vpd));
+        } else {
+            *dp_error = fmax(*dp_error, fabs(dp_float[i] - dp));
+            *ah_error = fmax(*ah_error, fabs(ah_float[i] - ah));
+            *vpd_error = fmax(*vpd_error, fabs(vpd_float[i] - vpd));
+        }
+    }
+}
+
+void bench_humidity(void)
+{
+    const double n = (double)NUM_ROUNDS * NUM_SAMPLES;
+    uint32_t x = 0x9e3779b9;
+
+    // sensor range: -40 to 125 °C and 0 to 100 %RH
+    for (int i = 0; i < NUM_SAMPLES; ++i) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+
+        t_raw[i] = 1872 + (x >> 16) % 61791;
+        rh_raw[i] = 3146 + (x & 0xffff) % 52429;
+    }
+
+    sht4x_convert(t_raw, rh_raw, NUM_SAMPLES, t_float, rh_float);
+
+    for (size_t k = 0; k < sizeof(impls) / sizeof(impls[0]); ++k) {
+        double dp_error, ah_error, vpd_error;
+        int64_t t0, t1;
+
+        t0 = bench_time_ns();
+
+        for (int r = 0; r < NUM_ROUNDS; ++r) {
+            impls[k].derive();
+        }
+
+        t1 = bench_time_ns();
+
+        max_error(impls[k].fixed, &dp_error, &ah_error, &vpd_error);
+
+        printf("{\"bench\": \"humidity\", \"impl\": \"%s\", \"ns_per_sample\": %.3f, "
+               "\"max_error\": {\"dew_point_c\": %.5f, \"absolute_humidity_g_m3\": %.5f, "
+               "\"vpd_kpa\": %.5f}}\n",
+               impls[k].name, (t1 - t0) / n, dp_error, ah_error, vpd_error);
+    }
+}
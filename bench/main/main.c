@@ -0,0 +1,17 @@
+/**
+ * @file main.c
+ *
+ * Run benchmarks on linux.
+ */
+
+#include "bench.h"
+
+void app_main(void)
+{
+    bench_crc();
+    bench_convert();
+    bench_humidity();
+    bench_measure();
+    bench_retry();
+    bench_sweep();
+}
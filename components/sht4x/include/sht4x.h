@@ -6,8 +6,26 @@
 
 #pragma once
 
+#include "sdkconfig.h"
+#include "esp_assert.h"
 #include "esp_err.h"
+#include "sht4x_filter.h"
+#include "freertos/FreeRTOS.h"
+
+#if CONFIG_SHT4X_I2C_MASTER
+#include "driver/i2c_types.h"
+#else
 #include "driver/i2c.h"
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/** Error returned when a measurement does not fit into its time budget. */
+#define SHT4X_ERR_DEADLINE 0x14001
+
+/** Error returned when a restored handle finds a sensor with another serial number. */
+#define SHT4X_ERR_SERIAL 0x14002
 
 /** Type for SHT4X object handle. */
 typedef struct sht4x *sht4x_t;
@@ -23,6 +41,90 @@ typedef enum {
     SHT4X_HEAT_20_100 // activate with  20 mW for 0.1 s
 } sht4x_heat_t;
 
+/**< Measurement precision (repeatability); see datasheet Table 4 */
+typedef enum {
+    SHT4X_PRECISION_HIGH, // high repeatability, ~10 ms
+    SHT4X_PRECISION_MEDIUM, // medium repeatability, ~4.5 ms
+    SHT4X_PRECISION_LOW // low repeatability, ~1.7 ms
+} sht4x_precision_t;
+
+/**< Status of a sample */
+typedef enum {
+    SHT4X_SAMPLE_OK, // valid measurement
+    SHT4X_SAMPLE_LATE, // valid measurement, started at or after the time of the next sample
+    SHT4X_SAMPLE_FAILED // measurement failed; temperature and humidity are 0
+} sht4x_sample_status_t;
+
+/** Timestamped raw measurement (16 bytes). */
+typedef struct {
+    int64_t timestamp; // time (µs, see esp_timer_get_time()) of measurement
+    uint16_t temperature; // raw temperature in [0, 0xffff)
+    uint16_t humidity; // raw relative humidity in [0, 0xffff)
+    bool heated; // measured with heater activation
+    uint8_t status; // sht4x_sample_status_t
+} sht4x_sample_t;
+
+// natural layout without padding, rather than packed: samples in arrays
+// stay aligned, and the 8-byte timestamp is read in one access
+ESP_STATIC_ASSERT(sizeof(sht4x_sample_t) == 16, "sht4x_sample_t is not 16 bytes");
+
+/** Value of sht4x_state_t.magic of a saved handle state. */
+#define SHT4X_STATE_MAGIC 0x53485434
+
+/**
+ * Handle state to keep across deep sleep, e.g. in RTC memory
+ * (RTC_DATA_ATTR); see sht4x_save_state() and sht4x_init_from_state().
+ */
+typedef struct {
+    uint32_t magic; // SHT4X_STATE_MAGIC once saved
+    uint32_t serial; // serial number
+    uint8_t port; // I2C port number
+    uint8_t address; // I2C device address
+    uint8_t precision; // measurement precision (sht4x_precision_t)
+    uint8_t oversampling; // measurements averaged into each reported one
+    sht4x_filter_t filter[2]; // temperature, humidity
+} sht4x_state_t;
+
+/** Number of buckets of the measurement latency histogram. */
+#define SHT4X_STATS_LATENCY_BUCKETS 12
+
+/**
+ * Handle statistics.
+ *
+ * Bucket i of `latency` counts successful measurements that took
+ * [2^(i+9), 2^(i+10)) µs from the first command to the result,
+ * including retries; the first (last) bucket also counts faster
+ * (slower) measurements.
+ */
+typedef struct {
+    uint32_t transactions; // commands sent
+    uint32_t transfers; // I2C transfers (including polls)
+    uint32_t polls; // reads not acknowledged while polling for a result
+    uint32_t crc_errors; // responses with invalid CRC
+    uint32_t retries; // commands sent again after a CRC error
+    uint32_t i2c_nack; // I2C transfers that failed with ESP_FAIL (no acknowledge)
+    uint32_t i2c_timeout; // I2C transfers that failed with ESP_ERR_TIMEOUT (bus busy)
+    uint32_t i2c_other; // I2C transfers that failed with another error
+    esp_err_t i2c_last_error; // error of the last failed I2C transfer
+    uint32_t latency[SHT4X_STATS_LATENCY_BUCKETS]; // measurement latency histogram
+} sht4x_stats_t;
+
+/**
+ * Memory of a sensor handle; see sht4x_init_static().
+ *
+ * The members only size and align the storage; the driver checks at
+ * build time that a handle fits.
+ */
+typedef struct {
+    StaticSemaphore_t lock;
+#if CONFIG_SHT4X_I2C_MASTER_ASYNC
+    StaticSemaphore_t bus;
+#endif
+    sht4x_filter_t filter[2];
+    sht4x_stats_t stats;
+    int64_t reserved[24];
+} sht4x_storage_t;
+
 /**
  * Initialize SHT4x sensor.
  *
@@ -34,6 +136,77 @@ typedef enum {
  */
 esp_err_t sht4x_init(i2c_port_t port, uint8_t address, sht4x_t *sht4x);
 
+/**
+ * Initialize SHT4x sensor in caller-provided memory.
+ *
+ * Like sht4x_init(), but the handle lives in `storage`, which must
+ * outlive it; sht4x_delete() leaves the memory to the caller.
+ *
+ * @param port I2C port number
+ * @param address I2C device address
+ * @param storage Memory of the handle
+ * @param sht4x Sensor handle
+ *
+ * @return ESP_OK on success.
+ */
+esp_err_t sht4x_init_static(i2c_port_t port, uint8_t address, sht4x_storage_t *storage,
+                            sht4x_t *sht4x);
+
+/**
+ * Initialize SHT4x sensor from saved handle state.
+ *
+ * Unlike sht4x_init(), neither waits for the sensor to power on nor
+ * reads its serial number, so the first measurement after waking from
+ * deep sleep takes one conversion time. The handle continues with the
+ * saved serial number, port, address, precision and filters.
+ *
+ * With `verify`, the first measurement (or sht4x_start_measure())
+ * reads the serial number before it starts. If it differs from the
+ * saved one, that call fails with SHT4X_ERR_SERIAL; the handle then
+ * takes the new serial number and resets its filters.
+ *
+ * @param state Saved handle state
+ * @param verify Check serial number on first measurement
+ * @param sht4x Sensor handle
+ *
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if `state` was not
+ *         saved by sht4x_save_state() or is corrupt.
+ */
+esp_err_t sht4x_init_from_state(const sht4x_state_t *state, bool verify, sht4x_t *sht4x);
+
+/**
+ * Discover SHT4x sensors.
+ *
+ * Sends the serial number command to the addresses of all SHT4x
+ * variants (0x44, 0x45 and 0x46) on each port, waits once for all of
+ * them, and initializes a handle for each sensor that responds with a
+ * valid CRC. Responses with invalid CRC are retried (up to
+ * CONFIG_SHT4X_NUM_RETRY times), again all at once. Discovery takes
+ * about one conversion time, however many sensors there are.
+ *
+ * @param ports I2C port numbers
+ * @param num_ports Number of ports, at most I2C_NUM_MAX
+ * @param sensors Handles of discovered sensors, ordered by port and address
+ * @param max_sensors Size of `sensors`
+ * @param count Number of discovered sensors
+ *
+ * @return ESP_OK on success (even if no sensor responds),
+ *         ESP_ERR_INVALID_SIZE if more than `max_sensors` sensors
+ *         respond (the others are left out).
+ */
+esp_err_t sht4x_discover(const i2c_port_t *ports, size_t num_ports, sht4x_t *sensors,
+                         size_t max_sensors, size_t *count);
+
+/**
+ * Save handle state, e.g. before entering deep sleep.
+ *
+ * @param sht4x Sensor handle
+ * @param state Handle state
+ *
+ * @return ESP_OK on success.
+ */
+esp_err_t sht4x_save_state(sht4x_t sht4x, sht4x_state_t *state);
+
 /**
  * Soft reset sensor.
  *
@@ -57,6 +230,38 @@ esp_err_t sht4x_reset(sht4x_t sht4x);
  */
 esp_err_t sht4x_get_serial(sht4x_t sht4x, uint32_t *serial);
 
+/**
+ * Set measurement precision.
+ *
+ * The precision applies to measurements without heater activation;
+ * heater measurements always use high precision. The default is set
+ * by CONFIG_SHT4X_PRECISION.
+ *
+ * @param sht4x Sensor handle
+ * @param precision Measurement precision
+ *
+ * @return ESP_OK on success.
+ */
+esp_err_t sht4x_set_precision(sht4x_t sht4x, sht4x_precision_t precision);
+
+/**
+ * Set filter of measurements.
+ *
+ * Each reported measurement without heater activation is the rounded
+ * average of `oversampling` measurements (blocking calls only), which
+ * is then passed through the filter; the filtered value is what the
+ * measurement functions (and sht4x_get_latest()) return. Heated
+ * measurements bypass the filter. Setting a filter resets its state.
+ *
+ * @param sht4x Sensor handle
+ * @param config Filter configuration
+ *
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if the configuration
+ *         is out of range.
+ */
+esp_err_t sht4x_set_filter(sht4x_t sht4x, const sht4x_filter_config_t *config);
+
+#if CONFIG_SHT4X_FLOAT_API
 /**
  * Measure temperature and humidity.
  *
@@ -80,6 +285,35 @@ esp_err_t sht4x_measure(sht4x_t sht4x, float *temperature, float *humidity);
  */
 esp_err_t sht4x_heat_measure(sht4x_t sht4x, sht4x_heat_t heat,
                              float *temperature, float *humidity);
+#endif
+
+/**
+ * Measure temperature and humidity in fixed point.
+ *
+ * The conversion uses integer arithmetic only; the results are
+ * rounded to the nearest m°C and m%RH.
+ *
+ * @param sht4x Sensor handle
+ * @param temperature Temperature (m°C)
+ * @param humidity Relative humidity (m%RH) in [0, 100000]
+ *
+ * @return ESP_OK on success.
+ */
+esp_err_t sht4x_measure_fixed(sht4x_t sht4x, int32_t *temperature, int32_t *humidity);
+
+/**
+ * Measure temperature and humidity in fixed point after heater
+ * activation (if any).
+ *
+ * @param sht4x Sensor handle
+ * @param heat Heater activation option
+ * @param temperature Temperature (m°C)
+ * @param humidity Relative humidity (m%RH) in [0, 100000]
+ *
+ * @return ESP_OK on success.
+ */
+esp_err_t sht4x_heat_measure_fixed(sht4x_t sht4x, sht4x_heat_t heat,
+                                   int32_t *temperature, int32_t *humidity);
 
 /**
  * Measure raw temperature and humidity data.
@@ -105,9 +339,210 @@ esp_err_t sht4x_measure_raw(sht4x_t sht4x, uint32_t *temperature, uint32_t *humi
 esp_err_t sht4x_heat_measure_raw(sht4x_t sht4x, sht4x_heat_t heat,
                                  uint32_t *temperature, uint32_t *humidity);
 
+/**
+ * Measure raw temperature and humidity data within a time budget.
+ *
+ * Waiting for the handle, every I2C transfer, and the conversion are
+ * limited to the remaining budget. Failed transfers and responses
+ * with invalid CRC are retried with exponential backoff (starting at
+ * CONFIG_SHT4X_RETRY_DELAY_MS) as long as another conversion fits into
+ * the budget. The call returns within `timeout_us` plus at most one
+ * tick.
+ *
+ * @param sht4x Sensor handle
+ * @param heat Heater activation option
+ * @param timeout_us Time budget (µs)
+ * @param temperature Temperature in [0, 0xffff)
+ * @param humidity Relative humidity in [0, 0xffff)
+ *
+ * @return ESP_OK on success, SHT4X_ERR_DEADLINE if the budget runs
+ *         out, or ESP_ERR_TIMEOUT if all CONFIG_SHT4X_NUM_RETRY
+ *         retries failed.
+ */
+esp_err_t sht4x_heat_measure_raw_timeout(sht4x_t sht4x, sht4x_heat_t heat,
+                                         int64_t timeout_us, uint32_t *temperature,
+                                         uint32_t *humidity);
+
+/**
+ * Measure raw temperature and humidity data within a time budget.
+ *
+ * See sht4x_heat_measure_raw_timeout().
+ *
+ * @param sht4x Sensor handle
+ * @param timeout_us Time budget (µs)
+ * @param temperature Temperature in [0, 0xffff)
+ * @param humidity Relative humidity in [0, 0xffff)
+ *
+ * @return ESP_OK on success, SHT4X_ERR_DEADLINE if the budget runs
+ *         out, or ESP_ERR_TIMEOUT if all retries failed.
+ */
+esp_err_t sht4x_measure_raw_timeout(sht4x_t sht4x, int64_t timeout_us,
+                                    uint32_t *temperature, uint32_t *humidity);
+
+/**
+ * Measure temperature and humidity in fixed point within a time budget.
+ *
+ * See sht4x_heat_measure_raw_timeout().
+ *
+ * @param sht4x Sensor handle
+ * @param timeout_us Time budget (µs)
+ * @param temperature Temperature (m°C)
+ * @param humidity Relative humidity (m%RH) in [0, 100000]
+ *
+ * @return ESP_OK on success, SHT4X_ERR_DEADLINE if the budget runs
+ *         out, or ESP_ERR_TIMEOUT if all retries failed.
+ */
+esp_err_t sht4x_measure_fixed_timeout(sht4x_t sht4x, int64_t timeout_us,
+                                      int32_t *temperature, int32_t *humidity);
+
+#if CONFIG_SHT4X_FLOAT_API
+/**
+ * Measure temperature and humidity within a time budget.
+ *
+ * See sht4x_heat_measure_raw_timeout().
+ *
+ * @param sht4x Sensor handle
+ * @param timeout_us Time budget (µs)
+ * @param temperature Temperature (°C)
+ * @param humidity Relative humidity in [0.0, 100.0]
+ *
+ * @return ESP_OK on success, SHT4X_ERR_DEADLINE if the budget runs
+ *         out, or ESP_ERR_TIMEOUT if all retries failed.
+ */
+esp_err_t sht4x_measure_timeout(sht4x_t sht4x, int64_t timeout_us, float *temperature,
+                                float *humidity);
+#endif
+
+/**
+ * Get latest raw measurement, measuring only if it is too old.
+ *
+ * Returns the latest result of any measurement without heater
+ * activation if it was started at most `max_age_us` ago, and
+ * otherwise measures. Tasks calling concurrently wait for the same
+ * measurement rather than each starting one.
+ *
+ * @param sht4x Sensor handle
+ * @param max_age_us Maximum age (µs) of the measurement
+ * @param sample Timestamped raw measurement
+ *
+ * @return ESP_OK on success.
+ */
+esp_err_t sht4x_get_latest(sht4x_t sht4x, int64_t max_age_us, sht4x_sample_t *sample);
+
+/**
+ * Measure a burst of evenly spaced raw samples.
+ *
+ * Sample i is started `period_us` * i after the first one (or right
+ * after sample i - 1 if that took longer), measured like with
+ * sht4x_measure_raw(), and written to `samples[i]` with its start time
+ * and status. A failed measurement does not end the burst. The handle
+ * is held for the whole burst.
+ *
+ * @param sht4x Sensor handle
+ * @param samples Timestamped raw measurements
+ * @param n Number of samples
+ * @param period_us Time (µs) between the starts of consecutive samples
+ *
+ * @return ESP_OK if all samples are valid, or the error of the last
+ *         failed sample.
+ */
+esp_err_t sht4x_read_burst(sht4x_t sht4x, sht4x_sample_t *samples, size_t n,
+                           int64_t period_us);
+
+/**
+ * Start a measurement without waiting for the result.
+ *
+ * The result is fetched with sht4x_fetch_measure() or
+ * sht4x_fetch_measure_raw() once the conversion is complete. Only one
+ * measurement can be pending per sensor: until it is fetched, the
+ * other calls that talk to the sensor (measurements, sht4x_read_burst(),
+ * sht4x_reset(), and sht4x_get_latest() unless the cached sample is
+ * recent enough) return ESP_ERR_INVALID_STATE.
+ *
+ * @param sht4x Sensor handle
+ * @param heat Heater activation option
+ * @param ready Time (µs, see esp_timer_get_time()) from which
+ *              sht4x_fetch_measure_raw() tries to read the result: the
+ *              typical conversion time with CONFIG_SHT4X_WAIT_POLL
+ *              (reads may still return ESP_ERR_NOT_FINISHED until the
+ *              maximum), otherwise the maximum conversion time; may be
+ *              NULL
+ *
+ * @return ESP_OK on success, ESP_ERR_INVALID_STATE if a measurement is
+ *         already pending.
+ */
+esp_err_t sht4x_start_measure(sht4x_t sht4x, sht4x_heat_t heat, int64_t *ready);
+
+#if CONFIG_SHT4X_FLOAT_API
+/**
+ * Fetch temperature and humidity of a started measurement.
+ *
+ * @param sht4x Sensor handle
+ * @param temperature Temperature (°C)
+ * @param humidity Relative humidity in [0.0, 100.0]
+ *
+ * @return ESP_OK on success, ESP_ERR_NOT_FINISHED if the result is not
+ *         ready yet, ESP_ERR_INVALID_STATE if no measurement was
+ *         started, or ESP_ERR_INVALID_CRC if the data is corrupt.
+ */
+esp_err_t sht4x_fetch_measure(sht4x_t sht4x, float *temperature, float *humidity);
+#endif
+
+/**
+ * Fetch temperature and humidity of a started measurement in fixed point.
+ *
+ * @param sht4x Sensor handle
+ * @param temperature Temperature (m°C)
+ * @param humidity Relative humidity (m%RH) in [0, 100000]
+ *
+ * @return ESP_OK on success, ESP_ERR_NOT_FINISHED if the result is not
+ *         ready yet, ESP_ERR_INVALID_STATE if no measurement was
+ *         started, or ESP_ERR_INVALID_CRC if the data is corrupt.
+ */
+esp_err_t sht4x_fetch_measure_fixed(sht4x_t sht4x, int32_t *temperature,
+                                    int32_t *humidity);
+
+/**
+ * Fetch raw temperature and humidity data of a started measurement.
+ *
+ * @param sht4x Sensor handle
+ * @param temperature Temperature in [0, 0xffff)
+ * @param humidity Relative humidity in [0, 0xffff)
+ *
+ * @return ESP_OK on success, ESP_ERR_NOT_FINISHED if the result is not
+ *         ready yet, ESP_ERR_INVALID_STATE if no measurement was
+ *         started, or ESP_ERR_INVALID_CRC if the data is corrupt.
+ */
+esp_err_t sht4x_fetch_measure_raw(sht4x_t sht4x, uint32_t *temperature,
+                                  uint32_t *humidity);
+
+/**
+ * Get handle statistics.
+ *
+ * @param sht4x Sensor handle
+ * @param stats Statistics since initialization or sht4x_reset_stats()
+ *
+ * @return ESP_OK on success, ESP_ERR_NOT_SUPPORTED if statistics are
+ *         disabled (CONFIG_SHT4X_STATS).
+ */
+esp_err_t sht4x_get_stats(sht4x_t sht4x, sht4x_stats_t *stats);
+
+/**
+ * Reset handle statistics.
+ *
+ * @param sht4x Sensor handle
+ *
+ * @return ESP_OK on success, ESP_ERR_NOT_SUPPORTED if statistics are
+ *         disabled (CONFIG_SHT4X_STATS).
+ */
+esp_err_t sht4x_reset_stats(sht4x_t sht4x);
+
 /**
  * Deallocate memory.
  *
+ * Handles return to the heap, the static pool
+ * (CONFIG_SHT4X_STATIC_POOL_SIZE), or their caller-provided storage.
+ *
  * @param sht4x Sensor handle
  */
 void sht4x_delete(sht4x_t sht4x);
@@ -0,0 +1,45 @@
+/**
+ * @file sht4x_convert.h
+ *
+ * Batch conversion of raw SHT4x data to temperature and humidity.
+ */
+
+#pragma once
+
+#include "sdkconfig.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if CONFIG_SHT4X_FLOAT_API
+/**
+ * Convert raw temperature and humidity data.
+ *
+ * The conversion uses single-precision arithmetic, so results may
+ * differ from sht4x_measure() in the last bit. Either channel may be
+ * skipped by passing NULL for its input and output.
+ *
+ * @param temperature_raw Raw temperatures
+ * @param humidity_raw Raw relative humidities
+ * @param n Number of samples
+ * @param temperature Temperatures (°C)
+ * @param humidity Relative humidities in [0.0, 100.0]
+ */
+void sht4x_convert(const uint16_t *temperature_raw, const uint16_t *humidity_raw,
+                   size_t n, float *temperature, float *humidity);
+#endif
+
+/**
+ * Convert raw temperature and humidity data to fixed point.
+ *
+ * The results are identical to sht4x_measure_fixed(). Either channel
+ * may be skipped by passing NULL for its input and output.
+ *
+ * @param temperature_raw Raw temperatures
+ * @param humidity_raw Raw relative humidities
+ * @param n Number of samples
+ * @param temperature Temperatures (m°C)
+ * @param humidity Relative humidities (m%RH) in [0, 100000]
+ */
+void sht4x_convert_fixed(const uint16_t *temperature_raw, const uint16_t *humidity_raw,
+                         size_t n, int32_t *temperature, int32_t *humidity);
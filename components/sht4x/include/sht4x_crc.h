@@ -0,0 +1,50 @@
+/**
+ * @file sht4x_crc.h
+ *
+ * CRC-8 checksum (polynomial 0x31, initialization 0xff) of SHT4x data.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * CRC-8 checksum using the implementation selected by CONFIG_SHT4X_CRC.
+ *
+ * @param data Data
+ * @param len Length of data
+ *
+ * @return CRC-8 checksum.
+ */
+uint8_t sht4x_crc8(const uint8_t *data, size_t len);
+
+/**
+ * CRC-8 checksum computed one bit at a time (no table).
+ *
+ * @param data Data
+ * @param len Length of data
+ *
+ * @return CRC-8 checksum.
+ */
+uint8_t sht4x_crc8_bitwise(const uint8_t *data, size_t len);
+
+/**
+ * CRC-8 checksum computed one nibble at a time (16-byte table).
+ *
+ * @param data Data
+ * @param len Length of data
+ *
+ * @return CRC-8 checksum.
+ */
+uint8_t sht4x_crc8_nibble(const uint8_t *data, size_t len);
+
+/**
+ * CRC-8 checksum computed one byte at a time (256-byte table).
+ *
+ * @param data Data
+ * @param len Length of data
+ *
+ * @return CRC-8 checksum.
+ */
+uint8_t sht4x_crc8_table(const uint8_t *data, size_t len);
@@ -0,0 +1,86 @@
+/**
+ * @file sht4x_filter.h
+ *
+ * Incremental filters of raw SHT4x data.
+ *
+ * Each filter keeps just enough state to update its output in O(1)
+ * per value (O(window) for the median): an exponentially weighted
+ * moving average in 24.8 fixed point, a moving average with a running
+ * sum, or a moving median with a sorted copy of its window.
+ */
+
+#pragma once
+
+#include "esp_err.h"
+
+#include <stdint.h>
+
+/** Maximum window of moving average and median filters. */
+#define SHT4X_FILTER_MAX_WINDOW 16
+
+/** Filter type. */
+typedef enum {
+    SHT4X_FILTER_NONE, // pass values through
+    SHT4X_FILTER_EWMA, // exponentially weighted moving average
+    SHT4X_FILTER_MEAN, // moving average
+    SHT4X_FILTER_MEDIAN // moving median
+} sht4x_filter_type_t;
+
+/** Filter configuration. */
+typedef struct {
+    sht4x_filter_type_t type;
+    uint8_t shift; // EWMA: weight of each new value is 2^-shift, shift in [1, 8]
+    uint8_t window; // MEAN, MEDIAN: values in window, in [1, SHT4X_FILTER_MAX_WINDOW]
+    uint8_t oversampling; // measurements averaged into each value (see sht4x_set_filter()), 0 = 1
+} sht4x_filter_config_t;
+
+/** Filter state of one channel. */
+typedef struct {
+    sht4x_filter_type_t type;
+    uint8_t shift;
+    uint8_t window;
+    uint8_t count; // values in window (or 1 once an EWMA is initialized)
+    uint8_t next; // position of next value in `ring`
+    int32_t state; // EWMA (24.8 fixed point) or sum of values in window
+    uint16_t ring[SHT4X_FILTER_MAX_WINDOW]; // window, in order of arrival
+    uint16_t sorted[SHT4X_FILTER_MAX_WINDOW]; // MEDIAN: window, in ascending order
+} sht4x_filter_t;
+
+/**
+ * Initialize (or reset) filter.
+ *
+ * @param filter Filter state
+ * @param config Filter configuration
+ *
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if the configuration
+ *         is out of range.
+ */
+esp_err_t sht4x_filter_init(sht4x_filter_t *filter, const sht4x_filter_config_t *config);
+
+/**
+ * Restore filter state saved elsewhere (e.g. in RTC memory).
+ *
+ * The running sum of a moving average and the sorted window of a
+ * moving median are rebuilt from the saved window.
+ *
+ * @param filter Filter state
+ * @param saved Saved filter state
+ *
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if the saved state is
+ *         inconsistent.
+ */
+esp_err_t sht4x_filter_restore(sht4x_filter_t *filter, const sht4x_filter_t *saved);
+
+/**
+ * Add value to filter.
+ *
+ * The output follows the input from the first value on; moving
+ * averages and medians are taken over the values so far until the
+ * window is full.
+ *
+ * @param filter Filter state
+ * @param value Raw value
+ *
+ * @return Filtered raw value.
+ */
+uint16_t sht4x_filter_update(sht4x_filter_t *filter, uint16_t value);
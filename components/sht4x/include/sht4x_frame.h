@@ -0,0 +1,69 @@
+/**
+ * @file sht4x_frame.h
+ *
+ * Compact binary frames of timestamped raw measurements.
+ *
+ * A frame is
+ *
+ *     0xa5 | flags | sensor id | payload | CRC-8
+ *
+ * where the CRC-8 (see sht4x_crc8()) covers flags, sensor id and
+ * payload. All multi-byte values are little endian. The payload of a
+ * key frame (flags = 0x00) is
+ *
+ *     timestamp (ms, uint32) | temperature (uint16) | humidity (uint16)
+ *
+ * and the payload of a delta frame (flags = 0x01), relative to the
+ * previous frame of the same sensor, is
+ *
+ *     timestamp (ms, uint16) | temperature (int8) | humidity (int8)
+ *
+ * Temperature and humidity are raw sensor values.
+ */
+
+#pragma once
+
+#include "sht4x.h"
+
+#include <stdbool.h>
+
+#define SHT4X_FRAME_SYNC 0xa5 /**< First byte of each frame */
+#define SHT4X_FRAME_DELTA 0x01 /**< Flag of delta frames */
+#define SHT4X_FRAME_KEY_LEN 12 /**< Length of key frames */
+#define SHT4X_FRAME_DELTA_LEN 8 /**< Length of delta frames */
+#define SHT4X_FRAME_MAX_LEN SHT4X_FRAME_KEY_LEN /**< Maximum frame length */
+
+/** Key frame interval, so that decoders can resynchronize after data loss. */
+#define SHT4X_FRAME_KEY_INTERVAL 32
+
+/** Frame encoder state of one sensor. */
+typedef struct {
+    uint8_t sensor_id;
+    bool delta; // use delta frames when possible
+    uint32_t count; // number of frames since last key frame
+    uint32_t timestamp; // previous timestamp (ms)
+    uint16_t temperature; // previous raw temperature
+    uint16_t humidity; // previous raw humidity
+} sht4x_frame_encoder_t;
+
+/**
+ * Initialize frame encoder.
+ *
+ * @param encoder Encoder state
+ * @param sensor_id Sensor id written to each frame
+ * @param delta Encode samples as delta frames when they fit
+ */
+void sht4x_frame_encoder_init(sht4x_frame_encoder_t *encoder, uint8_t sensor_id,
+                              bool delta);
+
+/**
+ * Encode sample as frame.
+ *
+ * @param encoder Encoder state
+ * @param sample Sample
+ * @param frame Frame; must hold SHT4X_FRAME_MAX_LEN bytes
+ *
+ * @return Length of frame.
+ */
+size_t sht4x_frame_encode(sht4x_frame_encoder_t *encoder, const sht4x_sample_t *sample,
+                          uint8_t *frame);
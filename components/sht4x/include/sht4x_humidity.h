@@ -0,0 +1,134 @@
+/**
+ * @file sht4x_humidity.h
+ *
+ * Dew point, absolute humidity and vapor pressure deficit.
+ *
+ * All quantities follow from the Magnus formula for the saturation
+ * vapor pressure over water (Sensirion coefficients),
+ *
+ *     es(T) = 6.112 hPa * exp(17.62 * T / (243.12 + T)),
+ *
+ * with the actual vapor pressure e = RH / 100 * es(T):
+ *
+ *     dew point           Td  = 243.12 * g / (17.62 - g),
+ *                             g = ln(RH / 100) + 17.62 * T / (243.12 + T)
+ *     absolute humidity   AH  = 216.7 * e / (273.15 + T)
+ *     vapor press. def.   VPD = es(T) - e
+ *
+ * Neither form calls logf() or expf(). The float functions use
+ * minimax polynomials of log2 (max. error 1.5e-5) and exp2 (max.
+ * relative error 3.8e-6); the fixed-point functions take raw sensor
+ * data and use integer arithmetic with interpolation tables (129 +
+ * 2 x 65 entries) only.
+ *
+ * Max. error over the sensor range (-40 to 125 °C, 1 to 100 %RH)
+ * against the formulas above evaluated with libm in double precision:
+ *
+ *              dew point    absolute humidity        VPD
+ *     float    0.0004 °C    0.0005 %                 0.002 % or 0.001 kPa
+ *     fixed    0.005 °C     0.025 % (+ 1 mg/m³)      0.015 % (+ 1 Pa)
+ *
+ * Relative humidity is clamped to at least 1 %RH, where the dew point
+ * is still finite.
+ */
+
+#pragma once
+
+#include "sdkconfig.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if CONFIG_SHT4X_FLOAT_API
+/**
+ * Dew point.
+ *
+ * @param temperature Temperature (°C)
+ * @param humidity Relative humidity in [0.0, 100.0]
+ *
+ * @return Dew point (°C).
+ */
+float sht4x_dew_point(float temperature, float humidity);
+
+/**
+ * Absolute humidity.
+ *
+ * @param temperature Temperature (°C)
+ * @param humidity Relative humidity in [0.0, 100.0]
+ *
+ * @return Absolute humidity (g/m³).
+ */
+float sht4x_absolute_humidity(float temperature, float humidity);
+
+/**
+ * Vapor pressure deficit.
+ *
+ * @param temperature Temperature (°C)
+ * @param humidity Relative humidity in [0.0, 100.0]
+ *
+ * @return Vapor pressure deficit (kPa).
+ */
+float sht4x_vapor_pressure_deficit(float temperature, float humidity);
+
+/**
+ * Derive dew point, absolute humidity and vapor pressure deficit.
+ *
+ * Any output may be skipped by passing NULL.
+ *
+ * @param temperature Temperatures (°C)
+ * @param humidity Relative humidities in [0.0, 100.0]
+ * @param n Number of samples
+ * @param dew_point Dew points (°C)
+ * @param absolute_humidity Absolute humidities (g/m³)
+ * @param vpd Vapor pressure deficits (kPa)
+ */
+void sht4x_derive(const float *temperature, const float *humidity, size_t n,
+                  float *dew_point, float *absolute_humidity, float *vpd);
+#endif
+
+/**
+ * Dew point from raw data.
+ *
+ * @param temperature_raw Raw temperature
+ * @param humidity_raw Raw relative humidity
+ *
+ * @return Dew point (m°C).
+ */
+int32_t sht4x_dew_point_fixed(uint16_t temperature_raw, uint16_t humidity_raw);
+
+/**
+ * Absolute humidity from raw data.
+ *
+ * @param temperature_raw Raw temperature
+ * @param humidity_raw Raw relative humidity
+ *
+ * @return Absolute humidity (mg/m³).
+ */
+int32_t sht4x_absolute_humidity_fixed(uint16_t temperature_raw, uint16_t humidity_raw);
+
+/**
+ * Vapor pressure deficit from raw data.
+ *
+ * @param temperature_raw Raw temperature
+ * @param humidity_raw Raw relative humidity
+ *
+ * @return Vapor pressure deficit (Pa).
+ */
+int32_t sht4x_vapor_pressure_deficit_fixed(uint16_t temperature_raw, uint16_t humidity_raw);
+
+/**
+ * Derive dew point, absolute humidity and vapor pressure deficit from
+ * raw data.
+ *
+ * Any output may be skipped by passing NULL.
+ *
+ * @param temperature_raw Raw temperatures
+ * @param humidity_raw Raw relative humidities
+ * @param n Number of samples
+ * @param dew_point Dew points (m°C)
+ * @param absolute_humidity Absolute humidities (mg/m³)
+ * @param vpd Vapor pressure deficits (Pa)
+ */
+void sht4x_derive_fixed(const uint16_t *temperature_raw, const uint16_t *humidity_raw,
+                        size_t n, int32_t *dew_point, int32_t *absolute_humidity,
+                        int32_t *vpd);
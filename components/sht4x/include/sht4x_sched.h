@@ -0,0 +1,76 @@
+/**
+ * @file sht4x_sched.h
+ *
+ * Pipelined measurements of multiple SHT4x sensors.
+ */
+
+#pragma once
+
+#include "sht4x.h"
+
+/** Type for scheduler object handle. */
+typedef struct sht4x_sched *sht4x_sched_t;
+
+/** Result of one sensor in a sweep. */
+typedef struct {
+    esp_err_t err; // ESP_OK if the measurement succeeded
+    uint32_t temperature; // raw temperature in [0, 0xffff)
+    uint32_t humidity; // raw relative humidity in [0, 0xffff)
+} sht4x_sched_result_t;
+
+/**
+ * Create scheduler.
+ *
+ * @param capacity Maximum number of sensors
+ * @param sched Scheduler handle
+ *
+ * @return ESP_OK on success.
+ */
+esp_err_t sht4x_sched_create(size_t capacity, sht4x_sched_t *sched);
+
+/**
+ * Add sensor to scheduler.
+ *
+ * The scheduler takes ownership of the sensor handle; it is deleted
+ * by sht4x_sched_delete().
+ *
+ * @param sched Scheduler handle
+ * @param sht4x Sensor handle
+ *
+ * @return ESP_OK on success, ESP_ERR_NO_MEM if the scheduler is full,
+ *         ESP_ERR_INVALID_STATE if the sensor was already added.
+ */
+esp_err_t sht4x_sched_add(sht4x_sched_t sched, sht4x_t sht4x);
+
+/**
+ * Number of sensors in scheduler.
+ *
+ * @param sched Scheduler handle
+ *
+ * @return Number of sensors.
+ */
+size_t sht4x_sched_count(sht4x_sched_t sched);
+
+/**
+ * Measure all sensors.
+ *
+ * The measurement commands are sent back-to-back so that the sensors
+ * convert concurrently, and the results are collected once the
+ * slowest sensor is ready. A sweep thus takes about one conversion
+ * time, regardless of the number of sensors.
+ *
+ * @param sched Scheduler handle
+ * @param results Results in the order the sensors were added; must
+ *                hold sht4x_sched_count() entries
+ *
+ * @return ESP_OK if all sensors were measured, otherwise the error of
+ *         the first failed sensor.
+ */
+esp_err_t sht4x_sched_sweep(sht4x_sched_t sched, sht4x_sched_result_t *results);
+
+/**
+ * Deallocate memory of scheduler and all its sensors.
+ *
+ * @param sched Scheduler handle
+ */
+void sht4x_sched_delete(sht4x_sched_t sched);
@@ -0,0 +1,159 @@
+/**
+ * @file sht4x_stream.h
+ *
+ * Background sampling of a SHT4x sensor into a ring buffer.
+ */
+
+#pragma once
+
+#include "sht4x.h"
+
+/** Type for stream object handle. */
+typedef struct sht4x_stream *sht4x_stream_t;
+
+/** Stream statistics. */
+typedef struct {
+    uint32_t overflows; // samples dropped because the ring buffer was full
+    uint32_t errors; // failed measurements
+    size_t high_water; // maximum number of samples in the ring buffer
+    uint32_t heated; // heater pulses (see sht4x_stream_set_heater())
+    uint32_t recovering; // samples dropped while recovering from a heater pulse
+    uint32_t suppressed; // samples not reported (see sht4x_stream_set_report())
+} sht4x_stream_stats_t;
+
+/**
+ * Change-driven reporting.
+ *
+ * A sample is reported (added to the ring buffer) only if temperature
+ * or humidity differs by more than its deadband from the last reported
+ * sample, or if the last report is `heartbeat_ms` old. While samples
+ * are not reported, the sampling period doubles after each one, up to
+ * `max_period_ms`; it drops back to the stream period with the next
+ * change.
+ */
+typedef struct {
+    uint16_t temperature_deadband; // raw temperature deadband
+    uint16_t humidity_deadband; // raw humidity deadband
+    uint32_t heartbeat_ms; // maximum time between reports, or 0 for none
+    uint32_t max_period_ms; // maximum sampling period, or 0 for a fixed period
+} sht4x_stream_report_t;
+
+/**
+ * Periodic heater activation (e.g., against creep in condensing
+ * environments).
+ *
+ * Every `interval` periods, the stream takes a heated measurement
+ * instead of a normal one. Heated samples are marked as such; samples
+ * taken within `recovery_ms` after a heater pulse, while the sensor
+ * cools down, are dropped.
+ */
+typedef struct {
+    sht4x_heat_t heat; // heater activation option of the pulses
+    uint32_t interval; // periods between heater pulses, or 0 for none
+    uint32_t recovery_ms; // time after a heater pulse during which samples are dropped
+} sht4x_stream_heater_t;
+
+/**
+ * Start sampling sensor in a background task.
+ *
+ * The task measures the sensor every `period_ms` into a ring buffer
+ * of `capacity` samples, which is drained with sht4x_stream_read().
+ * Other tasks may keep using the sensor handle while the stream is
+ * running. The stream holds it for each normal measurement, but starts
+ * heater pulses with sht4x_start_measure(): while a pulse is pending,
+ * calls that talk to the sensor return ESP_ERR_INVALID_STATE (and
+ * sht4x_get_latest() still returns a recent enough cached sample). A
+ * measurement of the stream that finds another measurement pending
+ * counts as an error.
+ *
+ * The task priority, stack size and core are set by
+ * CONFIG_SHT4X_STREAM_TASK_PRIORITY, CONFIG_SHT4X_STREAM_TASK_STACK_SIZE
+ * and CONFIG_SHT4X_STREAM_TASK_CORE.
+ *
+ * @param sht4x Sensor handle
+ * @param period_ms Sampling period (ms)
+ * @param heat Heater activation option of each measurement
+ * @param capacity Number of samples in ring buffer
+ * @param stream Stream handle
+ *
+ * @return ESP_OK on success.
+ */
+esp_err_t sht4x_stream_start(sht4x_t sht4x, uint32_t period_ms, sht4x_heat_t heat,
+                             size_t capacity, sht4x_stream_t *stream);
+
+/**
+ * Set periodic heater activation.
+ *
+ * Takes effect with the next measurement. A heater pulse takes longer
+ * than a period with SHT4X_HEAT_*_1000 (~1 s); the next sample is then
+ * taken right after it, and readers keep being served from the ring
+ * buffer and sht4x_stream_get_latest() in the meantime.
+ *
+ * @param stream Stream handle
+ * @param heater Heater activation
+ *
+ * @return ESP_OK on success.
+ */
+esp_err_t sht4x_stream_set_heater(sht4x_stream_t stream, const sht4x_stream_heater_t *heater);
+
+/**
+ * Set change-driven reporting.
+ *
+ * Takes effect with the next measurement. Heated samples are always
+ * reported, but are not compared against. sht4x_stream_get_latest()
+ * still returns the latest sample, reported or not.
+ *
+ * @param stream Stream handle
+ * @param report Reporting, or NULL to report every sample
+ *
+ * @return ESP_OK on success.
+ */
+esp_err_t sht4x_stream_set_report(sht4x_stream_t stream, const sht4x_stream_report_t *report);
+
+/**
+ * Get latest sample without heater activation or recovery.
+ *
+ * Never waits for a measurement. Use this instead of
+ * sht4x_get_latest() while the stream is running.
+ *
+ * @param stream Stream handle
+ * @param sample Latest sample
+ *
+ * @return ESP_OK on success, ESP_ERR_NOT_FOUND if there is no such
+ *         sample yet.
+ */
+esp_err_t sht4x_stream_get_latest(sht4x_stream_t stream, sht4x_sample_t *sample);
+
+/**
+ * Read samples from ring buffer.
+ *
+ * Never blocks; must only be called from one task at a time.
+ *
+ * @param stream Stream handle
+ * @param samples Samples, oldest first
+ * @param max_samples Maximum number of samples to read
+ *
+ * @return Number of samples read.
+ */
+size_t sht4x_stream_read(sht4x_stream_t stream, sht4x_sample_t *samples,
+                         size_t max_samples);
+
+/**
+ * Get stream statistics.
+ *
+ * @param stream Stream handle
+ * @param stats Statistics
+ *
+ * @return ESP_OK on success.
+ */
+esp_err_t sht4x_stream_get_stats(sht4x_stream_t stream, sht4x_stream_stats_t *stats);
+
+/**
+ * Stop sampling and deallocate memory.
+ *
+ * Waits for a measurement in progress to complete. The sensor handle
+ * is not deleted.
+ *
+ * @param stream Stream handle
+ */
+void sht4x_stream_stop(sht4x_stream_t stream);
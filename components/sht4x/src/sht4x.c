@@ -5,21 +5,111 @@
  */
 
 #include "sht4x.h"
+#include "sht4x_bus.h"
+#include "sht4x_crc.h"
+#include "sht4x_priv.h"
 
 #include "esp_log.h"
 #include "esp_check.h"
-#include "driver/i2c.h"
+#include "esp_timer.h"
 
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <string.h>
 
 static const char *TAG = "sht4x";
 
 struct sht4x {
+    uint8_t storage; // STORAGE_HEAP, STORAGE_POOL or STORAGE_CALLER
     uint32_t serial;
-    i2c_port_t port;
-    uint8_t address;
+    bool verify; // serial number to be checked before the next measurement
+    sht4x_bus_dev_t dev;
+    SemaphoreHandle_t lock; // serializes users of this handle
+    StaticSemaphore_t lock_buffer;
+    sht4x_precision_t precision;
+    uint8_t oversampling; // measurements averaged into each reported one
+    sht4x_filter_t filter[2]; // temperature, humidity
+    bool pending; // measurement started, but not yet fetched
+    bool heated; // pending measurement activates heater
+    uint8_t cmd; // command of split (asynchronous) start
+    uint32_t delay; // conversion time (µs) of split (asynchronous) start
+    uint8_t response[6]; // response of split (asynchronous) fetch
+    esp_err_t result; // result of split (asynchronous) transfer
+    uint8_t split; // SPLIT_NONE, SPLIT_START or SPLIT_FETCH: split transfer awaiting its finish
+    TaskHandle_t split_task; // task that queued the split transfer and holds the handle
+    int64_t started; // time (µs) when pending measurement was started
+    int64_t ready; // time (µs) when pending measurement is ready
+#if CONFIG_SHT4X_WAIT_POLL
+    int64_t poll; // time (µs) to start polling for pending measurement
+#endif
+    int64_t deadline; // time (µs) by which the current call must return, or NO_DEADLINE
+    bool has_latest;
+    sht4x_sample_t latest; // latest measurement without heater activation
+#if CONFIG_SHT4X_STATS
+    sht4x_stats_t stats;
+#endif
 };
 
+#define NO_DEADLINE INT64_MAX
+
+enum { STORAGE_HEAP, STORAGE_POOL, STORAGE_CALLER };
+
+enum { SPLIT_NONE, SPLIT_START, SPLIT_FETCH };
+
+_Static_assert(sizeof(struct sht4x) <= sizeof(sht4x_storage_t), "sht4x_storage_t too small");
+_Static_assert(_Alignof(struct sht4x) <= _Alignof(sht4x_storage_t),
+               "sht4x_storage_t misaligned");
+
+#if CONFIG_SHT4X_STATIC_POOL_SIZE
+/** Static pool of handles, used instead of the heap. */
+static struct sht4x pool[CONFIG_SHT4X_STATIC_POOL_SIZE];
+static atomic_bool pool_used[CONFIG_SHT4X_STATIC_POOL_SIZE];
+#endif
+
+#if !CONFIG_SHT4X_WAIT_TICK
+/** Task waiting in sht4x_sleep_until(). */
+typedef struct sleeper {
+    int64_t t; // time (µs) to wake up
+    SemaphoreHandle_t wake;
+    struct sleeper *next;
+} sleeper_t;
+
+/** One-shot timer shared by all sleeping tasks, armed for the earliest of them. */
+static struct {
+    atomic_int state; // WAKE_TIMER_NONE, WAKE_TIMER_CREATING, WAKE_TIMER_READY or WAKE_TIMER_FAILED
+    SemaphoreHandle_t lock;
+    StaticSemaphore_t lock_buffer;
+    esp_timer_handle_t timer;
+    sleeper_t *sleepers; // in order of wake-up time
+} wake_timer;
+
+enum { WAKE_TIMER_NONE, WAKE_TIMER_CREATING, WAKE_TIMER_READY, WAKE_TIMER_FAILED };
+#endif
+
+#if CONFIG_SHT4X_STATS
+#define STATS_INC(sht4x, counter) (++(sht4x)->stats.counter)
+#else
+#define STATS_INC(sht4x, counter) ((void)(sht4x))
+#endif
+
+#if CONFIG_SHT4X_BUS_LOCK
+/** Per-port bus locks, shared by all handles on a port. */
+static struct {
+    atomic_int state; // BUS_LOCK_NONE, BUS_LOCK_CREATING or BUS_LOCK_READY
+    SemaphoreHandle_t lock;
+    StaticSemaphore_t buffer;
+} bus_locks[I2C_NUM_MAX];
+
+enum { BUS_LOCK_NONE, BUS_LOCK_CREATING, BUS_LOCK_READY };
+#endif
+
+/** Device addresses of the SHT4x variants (-A, -B and -C). */
+static const uint8_t SHT4X_ADDRESSES[] = {0x44, 0x45, 0x46};
+
 #define SHT4X_CMD_SERIAL 0x89
 #define SHT4X_CMD_RESET 0x94
 static const uint8_t SHT4X_CMD_MEASURE[] = {
@@ -27,24 +117,18 @@ static const uint8_t SHT4X_CMD_MEASURE[] = {
     [SHT4X_HEAT_200_100] = 0x32, [SHT4X_HEAT_110_1000] = 0x2f,
     [SHT4X_HEAT_110_100] = 0x24, [SHT4X_HEAT_20_1000] = 0x1e,
     [SHT4X_HEAT_20_100] = 0x15};
+static const uint8_t SHT4X_CMD_PRECISION[] = {
+    [SHT4X_PRECISION_HIGH] = 0xfd,
+    [SHT4X_PRECISION_MEDIUM] = 0xf6,
+    [SHT4X_PRECISION_LOW] = 0xe0};
 
-#define G_POLYNOM 0x31
-
-/** CRC checksum. */
-static uint8_t crc8(uint8_t *data, size_t len)
-{
-    uint8_t crc = 0xff;
-
-    for (size_t i = 0; i < len; ++i) {
-        crc ^= data[i];
-
-        for (int k = 0; k < 8; ++k) {
-            crc = crc & 0x80 ? (crc << 1) ^ G_POLYNOM : crc << 1;
-        }
-    }
-
-    return crc;
-}
+#if CONFIG_SHT4X_PRECISION_LOW
+#define SHT4X_PRECISION_DEFAULT SHT4X_PRECISION_LOW
+#elif CONFIG_SHT4X_PRECISION_MEDIUM
+#define SHT4X_PRECISION_DEFAULT SHT4X_PRECISION_MEDIUM
+#else
+#define SHT4X_PRECISION_DEFAULT SHT4X_PRECISION_HIGH
+#endif
 
 /**
  * Validate CRC of 6-byte payload {data, data, CRC, data, data, CRC}.
@@ -52,50 +136,52 @@ static uint8_t crc8(uint8_t *data, size_t len)
  */
 static bool valid_crc(uint8_t *data)
 {
-    return (crc8(data, 2) == data[2]) && (crc8(&data[3], 2) == data[5]);
-}
-
-static float raw_to_temperature(uint32_t raw)
-{
-    return -45.0 + 175.0 * raw / 65535.0;
+    return (sht4x_crc8(data, 2) == data[2]) && (sht4x_crc8(&data[3], 2) == data[5]);
 }
 
-static float raw_to_relative_humidity(uint32_t raw)
+/** Measurement command corresponding to precision and heating option. */
+static uint8_t measure_cmd(sht4x_t sht4x, sht4x_heat_t heat)
 {
-    float rh;
-
-    rh = -6.0 + 125.0 * raw / 65535.0;
-
-    // crop humidity to [0, 100]; see datasheet § 4.5
-    rh = (rh > 100.0f) ? 100.0f : rh;
-    rh = (rh < 0.0f) ? 0.0f : rh;
-
-    return rh;
+    // heater measurements always use "high repeatability"
+    return (heat == SHT4X_HEAT_NONE) ? SHT4X_CMD_PRECISION[sht4x->precision]
+                                     : SHT4X_CMD_MEASURE[heat];
 }
 
-/** Read delay (in ms) corresponding to heating option. */
-static TickType_t heat_delay(sht4x_heat_t heat)
+/** Read delay (in µs) corresponding to precision and heating option. */
+static uint32_t measure_delay(sht4x_t sht4x, sht4x_heat_t heat)
 {
-    TickType_t delay;
+    uint32_t delay;
 
-    // see datasheet, Table 4; only using "high repeatability"
-    // measurments that take ~10 ms (+ heating time)
+    // see datasheet, Table 4; "high repeatability" measurements take
+    // ~10 ms, "medium" ~4.5 ms and "low" ~1.7 ms (+ heating time)
 
     switch (heat) {
     case SHT4X_HEAT_NONE:
-        delay = 10;
+        switch (sht4x->precision) {
+        case SHT4X_PRECISION_MEDIUM:
+            delay = 4500;
+            break;
+
+        case SHT4X_PRECISION_LOW:
+            delay = 1700;
+            break;
+
+        default:
+            delay = 10000;
+            break;
+        }
         break;
 
     case SHT4X_HEAT_200_1000:
     case SHT4X_HEAT_110_1000:
     case SHT4X_HEAT_20_1000:
-        delay = 1010;
+        delay = 1010000;
         break;
 
     case SHT4X_HEAT_200_100:
     case SHT4X_HEAT_110_100:
     case SHT4X_HEAT_20_100:
-        delay = 110;
+        delay = 110000;
         break;
 
     default:
@@ -107,154 +193,1344 @@ static TickType_t heat_delay(sht4x_heat_t heat)
     return delay;
 }
 
-/** Send command and read response data. */
-static esp_err_t sht4x_write_read(sht4x_t sht4x, uint8_t cmd, uint8_t *data,
-                                  size_t len, TickType_t delay_ms)
+/** Number of ticks to wait for at least `delay_us`. */
+static TickType_t delay_ticks(uint32_t delay_us)
 {
-    uint32_t num_retry = CONFIG_SHT4X_NUM_RETRY + 1;
+    const uint32_t tick_us = 1000 * portTICK_PERIOD_MS;
 
-    do {
-        ESP_RETURN_ON_ERROR(i2c_master_write_to_device(sht4x->port, sht4x->address,
-                                                       &cmd, 1, portMAX_DELAY),
-                            TAG, "i2c_master_write_to_device");
+    return (delay_us + tick_us - 1) / tick_us;
+}
+
+#if !CONFIG_SHT4X_WAIT_TICK
+/** Arm wake-up timer for the earliest sleeper; caller must hold its lock. */
+static void wake_timer_arm(int64_t now)
+{
+    esp_timer_stop(wake_timer.timer); // fails if not armed
+
+    if (wake_timer.sleepers) {
+        const int64_t delay = wake_timer.sleepers->t - now;
+
+        esp_timer_start_once(wake_timer.timer, (delay > 0) ? delay : 0);
+    }
+}
+
+/** Wake up sleepers that are due; runs in the esp_timer task. */
+static void wake_timer_expired(void *arg)
+{
+    int64_t now;
+
+    (void)arg;
+
+    xSemaphoreTake(wake_timer.lock, portMAX_DELAY);
+    now = esp_timer_get_time();
+
+    while (wake_timer.sleepers && wake_timer.sleepers->t <= now) {
+        sleeper_t *sleeper = wake_timer.sleepers;
+
+        wake_timer.sleepers = sleeper->next;
+        xSemaphoreGive(sleeper->wake); // `sleeper` may be gone from here on
+    }
+
+    wake_timer_arm(now);
+    xSemaphoreGive(wake_timer.lock);
+}
+
+/** Create wake-up timer (once); returns false if it cannot be created. */
+static bool wake_timer_init(void)
+{
+    const esp_timer_create_args_t args = {.callback = wake_timer_expired, .name = "sht4x"};
+    int expected = WAKE_TIMER_NONE;
+
+    if (atomic_compare_exchange_strong(&wake_timer.state, &expected, WAKE_TIMER_CREATING)) {
+        wake_timer.lock = xSemaphoreCreateMutexStatic(&wake_timer.lock_buffer);
+        atomic_store(&wake_timer.state, (esp_timer_create(&args, &wake_timer.timer) == ESP_OK)
+                                            ? WAKE_TIMER_READY
+                                            : WAKE_TIMER_FAILED);
+    }
+
+    while (atomic_load(&wake_timer.state) == WAKE_TIMER_CREATING) {
+        vTaskDelay(1); // another task is creating the timer
+    }
+
+    return atomic_load(&wake_timer.state) == WAKE_TIMER_READY;
+}
+#endif
+
+void sht4x_sleep_until(int64_t t)
+{
+    int64_t remaining = t - esp_timer_get_time();
+
+    if (remaining <= 0) {
+        return;
+    }
 
-        vTaskDelay(delay_ms / portTICK_PERIOD_MS);
+#if !CONFIG_SHT4X_WAIT_TICK
+    if (wake_timer_init()) {
+        StaticSemaphore_t buffer;
+        sleeper_t self = {.t = t, .wake = xSemaphoreCreateBinaryStatic(&buffer)};
+        sleeper_t **p;
 
-        ESP_RETURN_ON_ERROR(i2c_master_read_from_device(sht4x->port, sht4x->address,
-                                                        data, len, portMAX_DELAY),
-                            TAG, "i2c_master_read_from_device");
+        // block until the timer wakes us, rather than waiting out the
+        // last tick with esp_timer_get_time()
+        xSemaphoreTake(wake_timer.lock, portMAX_DELAY);
 
-        if (valid_crc(data)) {
-            return ESP_OK;
+        for (p = &wake_timer.sleepers; *p && (*p)->t <= t; p = &(*p)->next) {
         }
 
-        ESP_LOGE(TAG, "... retrying to read from sensor");
-        vTaskDelay(CONFIG_SHT4X_RETRY_DELAY_MS / portTICK_PERIOD_MS);
-    } while (--num_retry);
+        self.next = *p;
+        *p = &self;
 
-    return ESP_ERR_TIMEOUT;
+        if (wake_timer.sleepers == &self) {
+            wake_timer_arm(esp_timer_get_time());
+        }
+
+        xSemaphoreGive(wake_timer.lock);
+
+        xSemaphoreTake(self.wake, portMAX_DELAY);
+        vSemaphoreDelete(self.wake);
+        return;
+    }
+#endif
+
+    vTaskDelay(delay_ticks(remaining));
 }
 
-/** Read serial number from sensor. */
-static esp_err_t sht4x_read_serial(sht4x_t sht4x, uint32_t *serial)
+/** Ticks to wait for the bus and a transfer. */
+static TickType_t transfer_ticks(sht4x_t sht4x)
 {
-    uint8_t data[6];
+    TickType_t ticks = CONFIG_SHT4X_I2C_TIMEOUT_MS ? pdMS_TO_TICKS(CONFIG_SHT4X_I2C_TIMEOUT_MS)
+                                                  : portMAX_DELAY;
 
-    ESP_RETURN_ON_ERROR(sht4x_write_read(sht4x, SHT4X_CMD_SERIAL, data,
-                                         sizeof(data), 10),
-                        TAG, "sht4x_write_read");
+    if (sht4x->deadline != NO_DEADLINE) {
+        const int64_t remaining = sht4x->deadline - esp_timer_get_time();
+        const TickType_t left = (remaining > 0) ? remaining / (1000 * portTICK_PERIOD_MS) : 0;
 
-    *serial = ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) |
-              ((uint32_t)data[3] << 8) | data[4];
+        // a transfer takes far less than a tick, but needs at least one
+        ticks = (left < ticks) ? left : ticks;
+    }
 
-    return ESP_OK;
+    return ticks ? ticks : 1;
 }
 
-esp_err_t sht4x_init(i2c_port_t port, uint8_t address, sht4x_t *handle)
+/** Count failed I2C transfer. */
+static void stats_i2c_error(sht4x_t sht4x, esp_err_t err)
 {
-    struct sht4x *sht4x;
-    esp_err_t ret;
+#if CONFIG_SHT4X_STATS
+    if (err == ESP_FAIL) {
+        ++sht4x->stats.i2c_nack;
+    } else if (err == ESP_ERR_TIMEOUT) {
+        ++sht4x->stats.i2c_timeout;
+    } else {
+        ++sht4x->stats.i2c_other;
+    }
 
-    sht4x = malloc(sizeof(*sht4x));
-    if (!sht4x) {
-        *handle = NULL;
-        return ESP_ERR_NO_MEM;
+    sht4x->stats.i2c_last_error = err;
+#else
+    (void)sht4x;
+    (void)err;
+#endif
+}
+
+/** Add measurement latency to histogram. */
+static void stats_latency(sht4x_t sht4x, int64_t latency_us)
+{
+#if CONFIG_SHT4X_STATS
+    int bucket = (latency_us > 0) ? 63 - __builtin_clzll(latency_us) - 9 : 0;
+
+    if (bucket < 0) {
+        bucket = 0;
+    } else if (bucket >= SHT4X_STATS_LATENCY_BUCKETS) {
+        bucket = SHT4X_STATS_LATENCY_BUCKETS - 1;
     }
 
-    sht4x->port = port;
-    sht4x->address = address;
+    ++sht4x->stats.latency[bucket];
+#else
+    (void)sht4x;
+    (void)latency_us;
+#endif
+}
 
-    vTaskDelay(1); // SHT4x needs 1 ms to power on (1 tick ~= 10 ms)
-    ret = sht4x_read_serial(sht4x, &sht4x->serial);
+/** Create bus lock of `port` (once). */
+static void bus_lock_init(i2c_port_t port)
+{
+#if CONFIG_SHT4X_BUS_LOCK
+    int expected = BUS_LOCK_NONE;
 
-    if (ret == ESP_OK) {
-        ESP_LOGI(TAG, "found device 0x%08" PRIx32, sht4x->serial);
-    } else if (ret == ESP_ERR_TIMEOUT) {
-        ESP_LOGE(TAG, "timeout reading serial number: address=0x%02x", sht4x->address);
+    if (atomic_compare_exchange_strong(&bus_locks[port].state, &expected,
+                                       BUS_LOCK_CREATING)) {
+        bus_locks[port].lock = xSemaphoreCreateMutexStatic(&bus_locks[port].buffer);
+        atomic_store(&bus_locks[port].state, BUS_LOCK_READY);
     }
 
-    *handle = sht4x;
-    return ret;
+    while (atomic_load(&bus_locks[port].state) != BUS_LOCK_READY) {
+        vTaskDelay(1); // another task is creating the lock
+    }
+#else
+    (void)port;
+#endif
 }
 
-esp_err_t sht4x_get_serial(sht4x_t sht4x, uint32_t *serial)
+/** Write data to sensor, holding the bus for the transfer only. */
+static esp_err_t sht4x_i2c_write(sht4x_t sht4x, const uint8_t *data, size_t len)
 {
-    if (!sht4x) {
-        return ESP_ERR_INVALID_ARG;
+    const TickType_t ticks = transfer_ticks(sht4x);
+    esp_err_t ret;
+
+#if CONFIG_SHT4X_BUS_LOCK
+    if (xSemaphoreTake(bus_locks[sht4x->dev.port].lock, ticks) != pdTRUE) {
+        stats_i2c_error(sht4x, ESP_ERR_TIMEOUT);
+        return ESP_ERR_TIMEOUT; // bus busy
     }
+#endif
 
-    *serial = sht4x->serial;
-    return ESP_OK;
+    ret = sht4x_bus_write(&sht4x->dev, data, len, ticks);
+
+#if CONFIG_SHT4X_BUS_LOCK
+    xSemaphoreGive(bus_locks[sht4x->dev.port].lock);
+#endif
+
+    STATS_INC(sht4x, transfers);
+    if (ret != ESP_OK) {
+        stats_i2c_error(sht4x, ret);
+    }
+
+    return ret;
 }
 
-esp_err_t sht4x_reset(sht4x_t sht4x)
+/** Read data from sensor, holding the bus for the transfer only. */
+static esp_err_t sht4x_i2c_read(sht4x_t sht4x, uint8_t *data, size_t len)
 {
-    uint8_t cmd[] = {SHT4X_CMD_RESET};
+    const TickType_t ticks = transfer_ticks(sht4x);
     esp_err_t ret;
 
-    if (!sht4x) {
-        return ESP_ERR_INVALID_ARG;
+#if CONFIG_SHT4X_BUS_LOCK
+    if (xSemaphoreTake(bus_locks[sht4x->dev.port].lock, ticks) != pdTRUE) {
+        return ESP_ERR_TIMEOUT; // bus busy; counted by sht4x_fetch()
     }
+#endif
+
+    ret = sht4x_bus_read(&sht4x->dev, data, len, ticks);
+
+#if CONFIG_SHT4X_BUS_LOCK
+    xSemaphoreGive(bus_locks[sht4x->dev.port].lock);
+#endif
 
-    ret = i2c_master_write_to_device(sht4x->port, sht4x->address, cmd,
-                                     sizeof(cmd), portMAX_DELAY);
-    vTaskDelay(1); // SHT4x needs 1 ms to reset (1 tick ~= 10 ms)
+    STATS_INC(sht4x, transfers);
     return ret;
 }
 
-void sht4x_delete(sht4x_t sht4x)
+/** Command was sent; response can be read after `delay_us`. */
+static void sht4x_started(sht4x_t sht4x, uint32_t delay_us)
 {
-    free(sht4x);
+    const int64_t now = esp_timer_get_time();
+
+    sht4x->pending = true;
+    sht4x->started = now;
+    sht4x->ready = now + delay_us;
+#if CONFIG_SHT4X_WAIT_POLL
+    // typical conversion times are ~3/4 of the (maximum) delays
+    sht4x->poll = now + delay_us - delay_us / 4;
+#endif
 }
 
-esp_err_t sht4x_heat_measure_raw(sht4x_t sht4x, sht4x_heat_t heat,
-                                 uint32_t *temp, uint32_t *humidity)
+/** Send command; response can be read after `delay_us`. */
+static esp_err_t sht4x_start(sht4x_t sht4x, uint8_t cmd, uint32_t delay_us)
 {
-    uint8_t data[6];
-    TickType_t delay_ms;
+    STATS_INC(sht4x, transactions);
+    ESP_RETURN_ON_ERROR(sht4x_i2c_write(sht4x, &cmd, 1), TAG, "sht4x_i2c_write");
 
-    delay_ms = heat_delay(heat);
+    sht4x_started(sht4x, delay_us);
+    return ESP_OK;
+}
 
-    if (!sht4x || !delay_ms) {
-        return ESP_ERR_INVALID_ARG;
+/** Wait until response data of a started command can be read. */
+static void sht4x_wait(sht4x_t sht4x)
+{
+#if CONFIG_SHT4X_WAIT_POLL
+    sht4x_sleep_until(sht4x->poll);
+#else
+    sht4x_sleep_until(sht4x->ready);
+#endif
+}
+
+/** Time (µs) after which sht4x_fetch() may be called. */
+static int64_t sht4x_fetch_time(sht4x_t sht4x)
+{
+#if CONFIG_SHT4X_WAIT_POLL
+    return sht4x->poll;
+#else
+    return sht4x->ready;
+#endif
+}
+
+/**
+ * Read response data of a started command.
+ *
+ * When polling, the sensor NACKs reads until the response is ready;
+ * sht4x_fetch() then keeps polling (if `block`) or returns
+ * ESP_ERR_NOT_FINISHED, up until the maximum conversion time.
+ */
+static esp_err_t sht4x_fetch(sht4x_t sht4x, uint8_t *data, size_t len, bool block)
+{
+    esp_err_t ret;
+
+    ret = sht4x_i2c_read(sht4x, data, len);
+
+#if CONFIG_SHT4X_WAIT_POLL
+    while (ret == ESP_FAIL && esp_timer_get_time() < sht4x->ready) {
+        STATS_INC(sht4x, polls);
+
+        if (!block) {
+            return ESP_ERR_NOT_FINISHED;
+        }
+
+        sht4x_sleep_until(esp_timer_get_time() + CONFIG_SHT4X_POLL_INTERVAL_US);
+        ret = sht4x_i2c_read(sht4x, data, len);
     }
+#else
+    (void)block;
+#endif
 
-    ESP_RETURN_ON_ERROR(sht4x_write_read(sht4x, SHT4X_CMD_MEASURE[heat], data,
-                                         sizeof(data), delay_ms),
-                        TAG, "sht4x_write_read");
+    sht4x->pending = false;
+
+    if (ret != ESP_OK) {
+        stats_i2c_error(sht4x, ret);
+    }
+
+    ESP_RETURN_ON_ERROR(ret, TAG, "sht4x_i2c_read");
+
+    if (!valid_crc(data)) {
+        STATS_INC(sht4x, crc_errors);
+        return ESP_ERR_INVALID_CRC;
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * Send command and read response data.
+ *
+ * Responses with invalid CRC are retried. If the handle has a
+ * deadline, failed transfers are retried too, with exponential backoff,
+ * as long as another conversion completes before the deadline.
+ */
+static esp_err_t sht4x_write_read(sht4x_t sht4x, uint8_t cmd, uint8_t *data,
+                                  size_t len, uint32_t delay_us)
+{
+    const bool bounded = (sht4x->deadline != NO_DEADLINE);
+    uint32_t num_retry = CONFIG_SHT4X_NUM_RETRY + 1;
+    int64_t backoff_us = 1000 * CONFIG_SHT4X_RETRY_DELAY_MS;
+    esp_err_t ret;
+
+    do {
+        if (bounded && esp_timer_get_time() + delay_us > sht4x->deadline) {
+            return SHT4X_ERR_DEADLINE;
+        }
 
+        ret = sht4x_start(sht4x, cmd, delay_us);
+
+        if (!bounded) {
+            ESP_RETURN_ON_ERROR(ret, TAG, "sht4x_start");
+        }
+
+        if (ret == ESP_OK) {
+            sht4x_wait(sht4x);
+            ret = sht4x_fetch(sht4x, data, len, true);
+        }
+
+        if (ret != ESP_ERR_INVALID_CRC &&
+            !(bounded && (ret == ESP_FAIL || ret == ESP_ERR_TIMEOUT))) {
+            return ret;
+        }
+
+        if (num_retry == 1) {
+            break;
+        }
+
+        ESP_LOGE(TAG, "... retrying to read from sensor");
+        STATS_INC(sht4x, retries);
+
+        if (bounded) {
+            const int64_t t = esp_timer_get_time() + backoff_us;
+
+            sht4x_sleep_until((t < sht4x->deadline) ? t : sht4x->deadline);
+            backoff_us *= 2;
+        } else {
+            vTaskDelay(CONFIG_SHT4X_RETRY_DELAY_MS / portTICK_PERIOD_MS);
+        }
+    } while (--num_retry);
+
+    return ESP_ERR_TIMEOUT;
+}
+
+/** Unpack 6-byte measurement response into raw temperature and humidity. */
+static void unpack_measurement(const uint8_t *data, uint32_t *temp, uint32_t *humidity)
+{
     *temp = ((uint32_t)(data[0] << 8)) | data[1];
     *humidity = ((uint32_t)(data[3] << 8)) | data[4];
     ESP_LOGD(TAG,
              "measurement: %02x %02x %02x %02x %02x %02x: "
              "t=%" PRIu32 ", rh=%" PRIu32,
              data[0], data[1], data[2], data[3], data[4], data[5], *temp, *humidity);
+}
+
+/** Read serial number from sensor. */
+static esp_err_t sht4x_read_serial(sht4x_t sht4x, uint32_t *serial)
+{
+    uint8_t data[6];
+
+    ESP_RETURN_ON_ERROR(sht4x_write_read(sht4x, SHT4X_CMD_SERIAL, data,
+                                         sizeof(data), 10000),
+                        TAG, "sht4x_write_read");
+
+    *serial = ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) |
+              ((uint32_t)data[3] << 8) | data[4];
 
     return ESP_OK;
 }
 
-esp_err_t sht4x_heat_measure(sht4x_t sht4x, sht4x_heat_t heat, float *temp, float *humidity)
+/** Reset filter state, keeping its configuration. */
+static void reset_filter(sht4x_filter_t *filter)
 {
-    uint32_t t, rh;
+    const sht4x_filter_config_t config = {
+        .type = filter->type, .shift = filter->shift, .window = filter->window};
 
-    if (!sht4x) {
+    sht4x_filter_init(filter, &config);
+}
+
+/** Check serial number of a restored handle (once); caller must hold the handle lock. */
+static esp_err_t sht4x_verify(sht4x_t sht4x)
+{
+    uint32_t serial;
+
+    if (!sht4x->verify) {
+        return ESP_OK;
+    }
+
+    ESP_RETURN_ON_ERROR(sht4x_read_serial(sht4x, &serial), TAG, "sht4x_read_serial");
+    sht4x->verify = false;
+
+    if (serial != sht4x->serial) {
+        ESP_LOGW(TAG, "sensor replaced: serial 0x%08" PRIx32 " -> 0x%08" PRIx32,
+                 sht4x->serial, serial);
+        sht4x->serial = serial;
+        reset_filter(&sht4x->filter[0]);
+        reset_filter(&sht4x->filter[1]);
+        return SHT4X_ERR_SERIAL;
+    }
+
+    return ESP_OK;
+}
+
+/** Filter measurement and remember it as latest sample (if not heated). */
+static void sht4x_complete(sht4x_t sht4x, uint32_t *temp, uint32_t *humidity)
+{
+    if (!sht4x->heated) {
+        *temp = sht4x_filter_update(&sht4x->filter[0], *temp);
+        *humidity = sht4x_filter_update(&sht4x->filter[1], *humidity);
+        sht4x->latest.timestamp = sht4x->started;
+        sht4x->latest.temperature = *temp;
+        sht4x->latest.humidity = *humidity;
+        sht4x->latest.heated = false;
+        sht4x->latest.status = SHT4X_SAMPLE_OK;
+        sht4x->has_latest = true;
+    }
+}
+
+/** Measure; caller must hold the handle lock. */
+static esp_err_t sht4x_measure_locked(sht4x_t sht4x, sht4x_heat_t heat, uint32_t *temp,
+                                      uint32_t *humidity)
+{
+    const int64_t start = esp_timer_get_time();
+    uint32_t n, sum_temp = 0, sum_humidity = 0;
+    uint8_t data[6];
+    uint32_t delay_us;
+
+    delay_us = measure_delay(sht4x, heat);
+
+    if (!delay_us) {
         return ESP_ERR_INVALID_ARG;
     }
 
-    ESP_RETURN_ON_ERROR(sht4x_heat_measure_raw(sht4x, heat, &t, &rh), TAG,
-                        "sht4x_heat_measure_raw: heat=%d", heat);
+    // the sensor is still converting a measurement started with
+    // sht4x_start_measure(), whose result must not be lost
+    if (sht4x->pending) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    ESP_RETURN_ON_ERROR(sht4x_verify(sht4x), TAG, "sht4x_verify");
+
+    sht4x->heated = (heat != SHT4X_HEAT_NONE);
+    n = sht4x->heated ? 1 : sht4x->oversampling;
+
+    for (uint32_t i = 0; i < n; ++i) {
+        ESP_RETURN_ON_ERROR(sht4x_write_read(sht4x, measure_cmd(sht4x, heat), data,
+                                             sizeof(data), delay_us),
+                            TAG, "sht4x_write_read");
+
+        unpack_measurement(data, temp, humidity);
+        sum_temp += *temp;
+        sum_humidity += *humidity;
+    }
+
+    *temp = (sum_temp + n / 2) / n;
+    *humidity = (sum_humidity + n / 2) / n;
 
-    *temp = raw_to_temperature(t);
-    *humidity = raw_to_relative_humidity(rh);
+    stats_latency(sht4x, esp_timer_get_time() - start);
+    sht4x_complete(sht4x, temp, humidity);
     return ESP_OK;
 }
 
-esp_err_t sht4x_measure_raw(sht4x_t sht4x, uint32_t *temp, uint32_t *humidity)
+/** Allocate handle from the static pool or the heap. */
+static struct sht4x *sht4x_alloc(void)
 {
-    return sht4x_heat_measure_raw(sht4x, SHT4X_HEAT_NONE, temp, humidity);
+#if CONFIG_SHT4X_STATIC_POOL_SIZE
+    for (size_t i = 0; i < CONFIG_SHT4X_STATIC_POOL_SIZE; ++i) {
+        bool expected = false;
+
+        if (atomic_compare_exchange_strong(&pool_used[i], &expected, true)) {
+            pool[i].storage = STORAGE_POOL;
+            return &pool[i];
+        }
+    }
+
+    return NULL;
+#else
+    struct sht4x *sht4x = malloc(sizeof(*sht4x));
+
+    if (sht4x) {
+        sht4x->storage = STORAGE_HEAP;
+    }
+
+    return sht4x;
+#endif
+}
+
+/** Return handle memory to where it came from. */
+static void sht4x_free(struct sht4x *sht4x)
+{
+    switch (sht4x->storage) {
+    case STORAGE_HEAP:
+        free(sht4x);
+        break;
+
+#if CONFIG_SHT4X_STATIC_POOL_SIZE
+    case STORAGE_POOL:
+        atomic_store(&pool_used[sht4x - pool], false);
+        break;
+#endif
+
+    default:
+        break; // caller-provided storage
+    }
+}
+
+/**
+ * Set up handle with default configuration in `storage` (or allocated
+ * memory, if NULL) and add it to the bus.
+ */
+static esp_err_t sht4x_create(i2c_port_t port, uint8_t address, sht4x_storage_t *storage,
+                              sht4x_t *handle)
+{
+    struct sht4x *sht4x;
+    esp_err_t ret;
+
+    *handle = NULL;
+
+    if (port < 0 || port >= I2C_NUM_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (storage) {
+        sht4x = (struct sht4x *)storage;
+        sht4x->storage = STORAGE_CALLER;
+    } else if (!(sht4x = sht4x_alloc())) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    ret = sht4x_bus_add(&sht4x->dev, port, address);
+    if (ret != ESP_OK) {
+        sht4x_free(sht4x);
+        return ret;
+    }
+
+    sht4x->serial = 0;
+    sht4x->verify = false;
+    sht4x->lock = xSemaphoreCreateMutexStatic(&sht4x->lock_buffer);
+    sht4x->precision = SHT4X_PRECISION_DEFAULT;
+    sht4x->oversampling = 1;
+    sht4x_filter_init(&sht4x->filter[0], &(sht4x_filter_config_t){.type = SHT4X_FILTER_NONE});
+    sht4x_filter_init(&sht4x->filter[1], &(sht4x_filter_config_t){.type = SHT4X_FILTER_NONE});
+    sht4x->pending = false;
+    sht4x->split = SPLIT_NONE;
+    sht4x->deadline = NO_DEADLINE;
+    sht4x->has_latest = false;
+#if CONFIG_SHT4X_STATS
+    memset(&sht4x->stats, 0, sizeof(sht4x->stats));
+#endif
+    bus_lock_init(port);
+
+    *handle = sht4x;
+    return ESP_OK;
+}
+
+/** Create handle and read the serial number of its sensor. */
+static esp_err_t sht4x_init_storage(i2c_port_t port, uint8_t address,
+                                    sht4x_storage_t *storage, sht4x_t *handle)
+{
+    struct sht4x *sht4x;
+    esp_err_t ret;
+
+    ESP_RETURN_ON_ERROR(sht4x_create(port, address, storage, handle), TAG, "sht4x_create");
+    sht4x = *handle;
+
+    sht4x_sleep_until(esp_timer_get_time() + 1000); // SHT4x needs 1 ms to power on
+    ret = sht4x_read_serial(sht4x, &sht4x->serial);
+
+    if (ret == ESP_OK) {
+        ESP_LOGI(TAG, "found device 0x%08" PRIx32, sht4x->serial);
+    } else if (ret == ESP_ERR_TIMEOUT) {
+        ESP_LOGE(TAG, "timeout reading serial number: address=0x%02x", sht4x->dev.address);
+    }
+
+    return ret;
+}
+
+esp_err_t sht4x_init(i2c_port_t port, uint8_t address, sht4x_t *handle)
+{
+    return sht4x_init_storage(port, address, NULL, handle);
+}
+
+esp_err_t sht4x_init_static(i2c_port_t port, uint8_t address, sht4x_storage_t *storage,
+                            sht4x_t *handle)
+{
+    if (!storage) {
+        *handle = NULL;
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    return sht4x_init_storage(port, address, storage, handle);
+}
+
+esp_err_t sht4x_init_from_state(const sht4x_state_t *state, bool verify, sht4x_t *handle)
+{
+    struct sht4x *sht4x;
+
+    sht4x_filter_t filter[2];
+
+    // RTC memory survives resets that may leave it half written
+    if (!state || state->magic != SHT4X_STATE_MAGIC ||
+        state->precision > SHT4X_PRECISION_LOW || !state->oversampling ||
+        sht4x_filter_restore(&filter[0], &state->filter[0]) != ESP_OK ||
+        sht4x_filter_restore(&filter[1], &state->filter[1]) != ESP_OK) {
+        *handle = NULL;
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    ESP_RETURN_ON_ERROR(sht4x_create(state->port, state->address, NULL, handle), TAG,
+                        "sht4x_create");
+    sht4x = *handle;
+    sht4x->filter[0] = filter[0];
+    sht4x->filter[1] = filter[1];
+
+    // the sensor kept running while asleep: no need to wait for it
+    sht4x->serial = state->serial;
+    sht4x->verify = verify;
+    sht4x->precision = state->precision;
+    sht4x->oversampling = state->oversampling;
+
+    return ESP_OK;
+}
+
+esp_err_t sht4x_save_state(sht4x_t sht4x, sht4x_state_t *state)
+{
+    if (!sht4x || !state) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(sht4x->lock, portMAX_DELAY);
+    state->magic = SHT4X_STATE_MAGIC;
+    state->serial = sht4x->serial;
+    state->port = sht4x->dev.port;
+    state->address = sht4x->dev.address;
+    state->precision = sht4x->precision;
+    state->oversampling = sht4x->oversampling;
+    state->filter[0] = sht4x->filter[0];
+    state->filter[1] = sht4x->filter[1];
+    xSemaphoreGive(sht4x->lock);
+    return ESP_OK;
+}
+
+esp_err_t sht4x_discover(const i2c_port_t *ports, size_t num_ports, sht4x_t *sensors,
+                         size_t max_sensors, size_t *count)
+{
+    const uint8_t cmd = SHT4X_CMD_SERIAL;
+    sht4x_t candidates[I2C_NUM_MAX * sizeof(SHT4X_ADDRESSES)] = {NULL};
+    sht4x_t found[I2C_NUM_MAX * sizeof(SHT4X_ADDRESSES)] = {NULL};
+    size_t n = 0, remaining;
+    uint8_t data[6];
+    esp_err_t ret;
+
+    if (!ports || num_ports > I2C_NUM_MAX || (!sensors && max_sensors) || !count) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    *count = 0;
+
+    for (size_t i = 0; i < num_ports; ++i) {
+        for (size_t j = 0; j < sizeof(SHT4X_ADDRESSES); ++j, ++n) {
+            ret = sht4x_create(ports[i], SHT4X_ADDRESSES[j], NULL, &candidates[n]);
+
+            if (ret != ESP_OK) {
+                while (n--) {
+                    sht4x_delete(candidates[n]);
+                }
+
+                return ret;
+            }
+        }
+    }
+
+    sht4x_sleep_until(esp_timer_get_time() + 1000); // SHT4x needs 1 ms to power on
+
+    // send the command to all candidates, wait once for the slowest, and
+    // read all responses; only responses with invalid CRC are retried
+    remaining = n;
+    for (uint32_t round = 0; remaining && round <= CONFIG_SHT4X_NUM_RETRY; ++round) {
+        int64_t fetch = 0;
+
+        for (size_t k = 0; k < n; ++k) {
+            if (!candidates[k]) {
+                continue;
+            }
+
+            STATS_INC(candidates[k], transactions);
+
+            if (sht4x_i2c_write(candidates[k], &cmd, 1) == ESP_OK) {
+                sht4x_started(candidates[k], 10000);
+
+                if (sht4x_fetch_time(candidates[k]) > fetch) {
+                    fetch = sht4x_fetch_time(candidates[k]);
+                }
+            } else {
+                // no device at this address
+                sht4x_delete(candidates[k]);
+                candidates[k] = NULL;
+                --remaining;
+            }
+        }
+
+        sht4x_sleep_until(fetch);
+
+        for (size_t k = 0; k < n; ++k) {
+            if (!candidates[k]) {
+                continue;
+            }
+
+            ret = sht4x_fetch(candidates[k], data, sizeof(data), true);
+
+            if (ret == ESP_ERR_INVALID_CRC) {
+                continue; // retry in next round
+            } else if (ret == ESP_OK) {
+                found[k] = candidates[k];
+                found[k]->serial = ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) |
+                                   ((uint32_t)data[3] << 8) | data[4];
+                ESP_LOGI(TAG, "found device 0x%08" PRIx32 ": port=%d, address=0x%02x",
+                         found[k]->serial, found[k]->dev.port, found[k]->dev.address);
+            } else {
+                sht4x_delete(candidates[k]);
+            }
+
+            candidates[k] = NULL;
+            --remaining;
+        }
+    }
+
+    ret = ESP_OK;
+
+    for (size_t k = 0; k < n; ++k) {
+        sht4x_delete(candidates[k]); // invalid CRC in every round
+
+        if (!found[k]) {
+            continue;
+        }
+
+        if (*count < max_sensors) {
+            sensors[(*count)++] = found[k];
+        } else {
+            sht4x_delete(found[k]);
+            ret = ESP_ERR_INVALID_SIZE;
+        }
+    }
+
+    return ret;
+}
+
+esp_err_t sht4x_get_serial(sht4x_t sht4x, uint32_t *serial)
+{
+    if (!sht4x) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    *serial = sht4x->serial;
+    return ESP_OK;
+}
+
+esp_err_t sht4x_reset(sht4x_t sht4x)
+{
+    uint8_t cmd[] = {SHT4X_CMD_RESET};
+    esp_err_t ret;
+
+    if (!sht4x) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(sht4x->lock, portMAX_DELAY);
+
+    if (sht4x->pending) {
+        xSemaphoreGive(sht4x->lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    ret = sht4x_i2c_write(sht4x, cmd, sizeof(cmd));
+    sht4x_sleep_until(esp_timer_get_time() + 1000); // SHT4x needs 1 ms to reset
+    xSemaphoreGive(sht4x->lock);
+    return ret;
+}
+
+esp_err_t sht4x_set_precision(sht4x_t sht4x, sht4x_precision_t precision)
+{
+    if (!sht4x || (unsigned)precision > SHT4X_PRECISION_LOW) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(sht4x->lock, portMAX_DELAY);
+    sht4x->precision = precision;
+    xSemaphoreGive(sht4x->lock);
+    return ESP_OK;
+}
+
+esp_err_t sht4x_set_filter(sht4x_t sht4x, const sht4x_filter_config_t *config)
+{
+    sht4x_filter_t filter;
+
+    if (!sht4x || !config) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    ESP_RETURN_ON_ERROR(sht4x_filter_init(&filter, config), TAG, "sht4x_filter_init");
+
+    xSemaphoreTake(sht4x->lock, portMAX_DELAY);
+    sht4x->oversampling = config->oversampling ? config->oversampling : 1;
+    sht4x->filter[0] = filter;
+    sht4x->filter[1] = filter;
+    xSemaphoreGive(sht4x->lock);
+    return ESP_OK;
+}
+
+esp_err_t sht4x_get_stats(sht4x_t sht4x, sht4x_stats_t *stats)
+{
+#if CONFIG_SHT4X_STATS
+    if (!sht4x || !stats) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(sht4x->lock, portMAX_DELAY);
+    *stats = sht4x->stats;
+    xSemaphoreGive(sht4x->lock);
+    return ESP_OK;
+#else
+    (void)sht4x;
+    (void)stats;
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+esp_err_t sht4x_reset_stats(sht4x_t sht4x)
+{
+#if CONFIG_SHT4X_STATS
+    if (!sht4x) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(sht4x->lock, portMAX_DELAY);
+    memset(&sht4x->stats, 0, sizeof(sht4x->stats));
+    xSemaphoreGive(sht4x->lock);
+    return ESP_OK;
+#else
+    (void)sht4x;
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+void sht4x_delete(sht4x_t sht4x)
+{
+    if (!sht4x) {
+        return;
+    }
+
+    vSemaphoreDelete(sht4x->lock);
+    sht4x_bus_remove(&sht4x->dev);
+    sht4x_free(sht4x);
+}
+
+esp_err_t sht4x_start_measure(sht4x_t sht4x, sht4x_heat_t heat, int64_t *ready)
+{
+    uint32_t delay_us;
+    esp_err_t ret;
+
+    if (!sht4x) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    delay_us = measure_delay(sht4x, heat);
+
+    if (!delay_us) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(sht4x->lock, portMAX_DELAY);
+
+    if (sht4x->pending) {
+        xSemaphoreGive(sht4x->lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    sht4x->heated = (heat != SHT4X_HEAT_NONE);
+    ret = sht4x_verify(sht4x);
+
+    if (ret == ESP_OK) {
+        ret = sht4x_start(sht4x, measure_cmd(sht4x, heat), delay_us);
+    }
+
+    if (ret == ESP_OK && ready) {
+        *ready = sht4x_fetch_time(sht4x);
+    }
+
+    xSemaphoreGive(sht4x->lock);
+    ESP_RETURN_ON_ERROR(ret, TAG, "sht4x_start");
+    return ESP_OK;
+}
+
+esp_err_t sht4x_fetch_measure_raw(sht4x_t sht4x, uint32_t *temp, uint32_t *humidity)
+{
+    uint8_t data[6];
+    esp_err_t ret;
+
+    if (!sht4x) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(sht4x->lock, portMAX_DELAY);
+
+    if (!sht4x->pending) {
+        ret = ESP_ERR_INVALID_STATE;
+    } else if (esp_timer_get_time() < sht4x_fetch_time(sht4x)) {
+        ret = ESP_ERR_NOT_FINISHED;
+    } else if ((ret = sht4x_fetch(sht4x, data, sizeof(data), false)) == ESP_OK) {
+        stats_latency(sht4x, esp_timer_get_time() - sht4x->started);
+        unpack_measurement(data, temp, humidity);
+        sht4x_complete(sht4x, temp, humidity);
+    }
+
+    xSemaphoreGive(sht4x->lock);
+
+    if (ret == ESP_ERR_INVALID_STATE || ret == ESP_ERR_NOT_FINISHED) {
+        return ret;
+    }
+
+    ESP_RETURN_ON_ERROR(ret, TAG, "sht4x_fetch");
+    return ESP_OK;
+}
+
+#if CONFIG_SHT4X_FLOAT_API
+esp_err_t sht4x_fetch_measure(sht4x_t sht4x, float *temp, float *humidity)
+{
+    uint32_t t, rh;
+
+    ESP_RETURN_ON_ERROR(sht4x_fetch_measure_raw(sht4x, &t, &rh), TAG,
+                        "sht4x_fetch_measure_raw");
+
+    *temp = sht4x_raw_to_temperature(t);
+    *humidity = sht4x_raw_to_relative_humidity(rh);
+    return ESP_OK;
+}
+#endif
+
+esp_err_t sht4x_fetch_measure_fixed(sht4x_t sht4x, int32_t *temp, int32_t *humidity)
+{
+    uint32_t t, rh;
+
+    ESP_RETURN_ON_ERROR(sht4x_fetch_measure_raw(sht4x, &t, &rh), TAG,
+                        "sht4x_fetch_measure_raw");
+
+    *temp = sht4x_raw_to_temperature_fixed(t);
+    *humidity = sht4x_raw_to_relative_humidity_fixed(rh);
+    return ESP_OK;
+}
+
+esp_err_t sht4x_start_measure_async(sht4x_t sht4x, sht4x_heat_t heat, sht4x_async_t *async)
+{
+    uint32_t delay_us;
+    esp_err_t ret;
+
+    if (!sht4x) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    delay_us = measure_delay(sht4x, heat);
+
+    if (!delay_us) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(sht4x->lock, portMAX_DELAY);
+
+    if (sht4x->pending) {
+        xSemaphoreGive(sht4x->lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    ret = sht4x_verify(sht4x);
+    if (ret != ESP_OK) {
+        xSemaphoreGive(sht4x->lock);
+        return ret;
+    }
+
+    sht4x->heated = (heat != SHT4X_HEAT_NONE);
+    sht4x->cmd = measure_cmd(sht4x, heat);
+    sht4x->delay = delay_us;
+    STATS_INC(sht4x, transactions);
+
+#if SHT4X_BUS_ASYNC
+    // queued transfers are serialized by the bus driver, not the bus lock
+    STATS_INC(sht4x, transfers);
+    ret = sht4x_bus_write_async(&sht4x->dev, &sht4x->cmd, 1, async, &sht4x->result);
+    if (ret != ESP_OK) {
+        stats_i2c_error(sht4x, ret);
+    }
+#else
+    (void)async;
+    sht4x->result = sht4x_i2c_write(sht4x, &sht4x->cmd, 1);
+    ret = ESP_OK;
+#endif
+
+    if (ret != ESP_OK) {
+        xSemaphoreGive(sht4x->lock);
+    } else {
+        sht4x->split = SPLIT_START;
+        sht4x->split_task = xTaskGetCurrentTaskHandle();
+    }
+
+    return ret;
+}
+
+/** Whether the calling task holds the handle for a split transfer in `phase`. */
+static bool sht4x_split_owned(sht4x_t sht4x, uint8_t phase)
+{
+    return sht4x->split == phase && sht4x->split_task == xTaskGetCurrentTaskHandle();
+}
+
+esp_err_t sht4x_start_measure_finish(sht4x_t sht4x, int64_t *fetch)
+{
+    esp_err_t ret;
+
+    if (!sht4x || !fetch) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (!sht4x_split_owned(sht4x, SPLIT_START)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    ret = sht4x->result;
+    sht4x->split = SPLIT_NONE;
+
+    if (ret == ESP_OK) {
+        sht4x_started(sht4x, sht4x->delay);
+        *fetch = sht4x_fetch_time(sht4x);
+    } else if (SHT4X_BUS_ASYNC) {
+        stats_i2c_error(sht4x, ret); // sht4x_i2c_write() counts its own errors
+    }
+
+    xSemaphoreGive(sht4x->lock);
+    return ret;
+}
+
+esp_err_t sht4x_fetch_measure_async(sht4x_t sht4x, sht4x_async_t *async)
+{
+    esp_err_t ret;
+
+    if (!sht4x) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(sht4x->lock, portMAX_DELAY);
+
+    if (!sht4x->pending) {
+        xSemaphoreGive(sht4x->lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+#if SHT4X_BUS_ASYNC
+    // sht4x_i2c_read() counts its own transfers
+    STATS_INC(sht4x, transfers);
+    ret = sht4x_bus_read_async(&sht4x->dev, sht4x->response, sizeof(sht4x->response), async,
+                               &sht4x->result);
+#else
+    (void)async;
+    sht4x->result = sht4x_i2c_read(sht4x, sht4x->response, sizeof(sht4x->response));
+    ret = ESP_OK;
+#endif
+
+    if (ret != ESP_OK) {
+        sht4x->pending = false;
+        stats_i2c_error(sht4x, ret);
+        xSemaphoreGive(sht4x->lock);
+    } else {
+        sht4x->split = SPLIT_FETCH;
+        sht4x->split_task = xTaskGetCurrentTaskHandle();
+    }
+
+    return ret;
+}
+
+esp_err_t sht4x_fetch_measure_finish(sht4x_t sht4x, uint32_t *temp, uint32_t *humidity)
+{
+    esp_err_t ret;
+
+    if (!sht4x || !temp || !humidity) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (!sht4x_split_owned(sht4x, SPLIT_FETCH)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    ret = sht4x->result;
+    sht4x->split = SPLIT_NONE;
+
+#if CONFIG_SHT4X_WAIT_POLL
+    if (ret == ESP_FAIL && esp_timer_get_time() < sht4x->ready) {
+        STATS_INC(sht4x, polls);
+        xSemaphoreGive(sht4x->lock);
+        return ESP_ERR_NOT_FINISHED;
+    }
+#endif
+
+    sht4x->pending = false;
+
+    if (ret != ESP_OK) {
+        stats_i2c_error(sht4x, ret);
+    } else if (!valid_crc(sht4x->response)) {
+        STATS_INC(sht4x, crc_errors);
+        ret = ESP_ERR_INVALID_CRC;
+    } else {
+        stats_latency(sht4x, esp_timer_get_time() - sht4x->started);
+        unpack_measurement(sht4x->response, temp, humidity);
+        sht4x_complete(sht4x, temp, humidity);
+    }
+
+    xSemaphoreGive(sht4x->lock);
+    return ret;
+}
+
+esp_err_t sht4x_heat_measure_raw(sht4x_t sht4x, sht4x_heat_t heat,
+                                 uint32_t *temp, uint32_t *humidity)
+{
+    esp_err_t ret;
+
+    if (!sht4x) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // hold the handle (but not the bus) for the whole measurement
+    xSemaphoreTake(sht4x->lock, portMAX_DELAY);
+    ret = sht4x_measure_locked(sht4x, heat, temp, humidity);
+    xSemaphoreGive(sht4x->lock);
+
+    return ret;
+}
+
+esp_err_t sht4x_heat_measure_raw_timeout(sht4x_t sht4x, sht4x_heat_t heat,
+                                         int64_t timeout_us, uint32_t *temp,
+                                         uint32_t *humidity)
+{
+    const int64_t deadline = esp_timer_get_time() + timeout_us;
+    esp_err_t ret;
+
+    if (!sht4x || timeout_us < 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (xSemaphoreTake(sht4x->lock, timeout_us / (1000 * portTICK_PERIOD_MS)) != pdTRUE) {
+        return SHT4X_ERR_DEADLINE;
+    }
+
+    sht4x->deadline = deadline;
+    ret = sht4x_measure_locked(sht4x, heat, temp, humidity);
+    sht4x->deadline = NO_DEADLINE;
+    xSemaphoreGive(sht4x->lock);
+
+    return ret;
+}
+
+esp_err_t sht4x_measure_raw_timeout(sht4x_t sht4x, int64_t timeout_us, uint32_t *temp,
+                                    uint32_t *humidity)
+{
+    return sht4x_heat_measure_raw_timeout(sht4x, SHT4X_HEAT_NONE, timeout_us, temp,
+                                          humidity);
+}
+
+esp_err_t sht4x_measure_fixed_timeout(sht4x_t sht4x, int64_t timeout_us, int32_t *temp,
+                                      int32_t *humidity)
+{
+    uint32_t t, rh;
+
+    ESP_RETURN_ON_ERROR(sht4x_measure_raw_timeout(sht4x, timeout_us, &t, &rh), TAG,
+                        "sht4x_measure_raw_timeout");
+
+    *temp = sht4x_raw_to_temperature_fixed(t);
+    *humidity = sht4x_raw_to_relative_humidity_fixed(rh);
+    return ESP_OK;
+}
+
+#if CONFIG_SHT4X_FLOAT_API
+esp_err_t sht4x_measure_timeout(sht4x_t sht4x, int64_t timeout_us, float *temp,
+                                float *humidity)
+{
+    uint32_t t, rh;
+
+    ESP_RETURN_ON_ERROR(sht4x_measure_raw_timeout(sht4x, timeout_us, &t, &rh), TAG,
+                        "sht4x_measure_raw_timeout");
+
+    *temp = sht4x_raw_to_temperature(t);
+    *humidity = sht4x_raw_to_relative_humidity(rh);
+    return ESP_OK;
+}
+#endif
+
+esp_err_t sht4x_get_latest(sht4x_t sht4x, int64_t max_age_us, sht4x_sample_t *sample)
+{
+    uint32_t t, rh;
+    esp_err_t ret = ESP_OK;
+
+    if (!sht4x || !sample) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // concurrent callers wait here for an in-flight measurement, and
+    // then find its result in the cache
+    xSemaphoreTake(sht4x->lock, portMAX_DELAY);
+
+    if (!sht4x->has_latest || esp_timer_get_time() - sht4x->latest.timestamp > max_age_us) {
+        ret = sht4x_measure_locked(sht4x, SHT4X_HEAT_NONE, &t, &rh);
+    }
+
+    if (ret == ESP_OK) {
+        *sample = sht4x->latest;
+    }
+
+    xSemaphoreGive(sht4x->lock);
+    return ret;
+}
+
+esp_err_t sht4x_read_burst(sht4x_t sht4x, sht4x_sample_t *samples, size_t n,
+                           int64_t period_us)
+{
+    esp_err_t err, ret = ESP_OK;
+    int64_t start, scheduled;
+    uint32_t t, rh;
+
+    if (!sht4x || (!samples && n) || period_us < 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(sht4x->lock, portMAX_DELAY);
+
+    if (sht4x->pending) {
+        xSemaphoreGive(sht4x->lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    start = esp_timer_get_time();
+
+    for (size_t i = 0; i < n; ++i) {
+        sht4x_sample_t *sample = &samples[i];
+
+        scheduled = start + (int64_t)i * period_us;
+        sht4x_sleep_until(scheduled);
+
+        sample->timestamp = esp_timer_get_time();
+        sample->heated = false;
+        err = sht4x_measure_locked(sht4x, SHT4X_HEAT_NONE, &t, &rh);
+
+        if (err != ESP_OK) {
+            sample->temperature = 0;
+            sample->humidity = 0;
+            sample->status = SHT4X_SAMPLE_FAILED;
+            ret = err;
+        } else {
+            sample->temperature = t;
+            sample->humidity = rh;
+            sample->status = (period_us && sample->timestamp >= scheduled + period_us)
+                                 ? SHT4X_SAMPLE_LATE
+                                 : SHT4X_SAMPLE_OK;
+        }
+    }
+
+    xSemaphoreGive(sht4x->lock);
+    return ret;
+}
+
+#if CONFIG_SHT4X_FLOAT_API
+esp_err_t sht4x_heat_measure(sht4x_t sht4x, sht4x_heat_t heat, float *temp, float *humidity)
+{
+    uint32_t t, rh;
+
+    if (!sht4x) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    ESP_RETURN_ON_ERROR(sht4x_heat_measure_raw(sht4x, heat, &t, &rh), TAG,
+                        "sht4x_heat_measure_raw: heat=%d", heat);
+
+    *temp = sht4x_raw_to_temperature(t);
+    *humidity = sht4x_raw_to_relative_humidity(rh);
+    return ESP_OK;
+}
+#endif
+
+esp_err_t sht4x_heat_measure_fixed(sht4x_t sht4x, sht4x_heat_t heat, int32_t *temp,
+                                   int32_t *humidity)
+{
+    uint32_t t, rh;
+
+    if (!sht4x) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    ESP_RETURN_ON_ERROR(sht4x_heat_measure_raw(sht4x, heat, &t, &rh), TAG,
+                        "sht4x_heat_measure_raw: heat=%d", heat);
+
+    *temp = sht4x_raw_to_temperature_fixed(t);
+    *humidity = sht4x_raw_to_relative_humidity_fixed(rh);
+    return ESP_OK;
+}
+
+esp_err_t sht4x_measure_raw(sht4x_t sht4x, uint32_t *temp, uint32_t *humidity)
+{
+    return sht4x_heat_measure_raw(sht4x, SHT4X_HEAT_NONE, temp, humidity);
+}
+
+esp_err_t sht4x_measure_fixed(sht4x_t sht4x, int32_t *temp, int32_t *humidity)
+{
+    return sht4x_heat_measure_fixed(sht4x, SHT4X_HEAT_NONE, temp, humidity);
 }
 
+#if CONFIG_SHT4X_FLOAT_API
 esp_err_t sht4x_measure(sht4x_t sht4x, float *temp, float *humidity)
 {
     return sht4x_heat_measure(sht4x, SHT4X_HEAT_NONE, temp, humidity);
 }
+#endif
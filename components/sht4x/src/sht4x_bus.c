@@ -0,0 +1,264 @@
+/**
+ * @file sht4x_bus.c
+ *
+ * I2C backends of the SHT4x driver.
+ */
+
+#include "sht4x_bus.h"
+
+#include "esp_attr.h"
+#include "esp_check.h"
+
+#include <string.h>
+
+static const char *TAG = "sht4x_bus";
+
+void sht4x_async_init(sht4x_async_t *async)
+{
+    atomic_init(&async->pending, 0);
+#if SHT4X_BUS_ASYNC
+    async->done = xSemaphoreCreateBinaryStatic(&async->done_buffer);
+#endif
+}
+
+#if SHT4X_BUS_ASYNC
+/** Wait at most `ticks` for all transfers of the group; false on timeout. */
+static bool async_wait(sht4x_async_t *async, TickType_t ticks)
+{
+    const TickType_t start = xTaskGetTickCount();
+
+    // the semaphore may still be given by a group that ran empty before
+    while (atomic_load(&async->pending) > 0) {
+        const TickType_t elapsed = xTaskGetTickCount() - start;
+
+        if (ticks != portMAX_DELAY && elapsed >= ticks) {
+            return false;
+        }
+
+        xSemaphoreTake(async->done, (ticks == portMAX_DELAY) ? portMAX_DELAY : ticks - elapsed);
+    }
+
+    return true;
+}
+#endif
+
+void sht4x_async_wait(sht4x_async_t *async)
+{
+#if SHT4X_BUS_ASYNC
+    async_wait(async, portMAX_DELAY);
+#else
+    (void)async;
+#endif
+}
+
+#if CONFIG_SHT4X_I2C_MASTER
+
+/** Map errors of the bus/device driver to those of the legacy driver. */
+static esp_err_t map_error(esp_err_t err)
+{
+    // a missing acknowledge fails the transaction as invalid response
+    // (or state, before ESP-IDF v5.3)
+    return (err == ESP_ERR_INVALID_RESPONSE || err == ESP_ERR_INVALID_STATE) ? ESP_FAIL
+                                                                             : err;
+}
+
+#if SHT4X_BUS_ASYNC
+/** Transfer completed; called from ISR. */
+static bool IRAM_ATTR on_trans_done(i2c_master_dev_handle_t handle,
+                                    const i2c_master_event_data_t *event, void *arg)
+{
+    sht4x_bus_dev_t *dev = arg;
+    sht4x_async_t *async = dev->async;
+    BaseType_t woken = pdFALSE;
+
+    (void)handle;
+
+    switch (event->event) {
+    case I2C_EVENT_DONE:
+        *dev->result = ESP_OK;
+        break;
+    case I2C_EVENT_NACK:
+        *dev->result = ESP_FAIL;
+        break;
+    case I2C_EVENT_TIMEOUT:
+        *dev->result = ESP_ERR_TIMEOUT;
+        break;
+    default:
+        return false; // transfer still in progress
+    }
+
+    if (atomic_fetch_sub(&async->pending, 1) == 1) {
+        xSemaphoreGiveFromISR(async->done, &woken);
+    }
+
+    return woken == pdTRUE;
+}
+#endif
+
+esp_err_t sht4x_bus_add(sht4x_bus_dev_t *dev, i2c_port_t port, uint8_t address)
+{
+    const i2c_device_config_t config = {
+        .dev_addr_length = I2C_ADDR_BIT_LEN_7,
+        .device_address = address,
+        .scl_speed_hz = CONFIG_SHT4X_I2C_MASTER_SCL_SPEED_HZ,
+    };
+    i2c_master_bus_handle_t bus;
+
+    dev->port = port;
+    dev->address = address;
+
+    ESP_RETURN_ON_ERROR(i2c_master_get_bus_handle(port, &bus), TAG,
+                        "no bus on port %d", port);
+    ESP_RETURN_ON_ERROR(i2c_master_bus_add_device(bus, &config, &dev->handle), TAG,
+                        "i2c_master_bus_add_device");
+
+#if SHT4X_BUS_ASYNC
+    sht4x_async_init(&dev->sync);
+
+    const i2c_master_event_callbacks_t callbacks = {.on_trans_done = on_trans_done};
+    esp_err_t ret = i2c_master_register_event_callbacks(dev->handle, &callbacks, dev);
+
+    if (ret != ESP_OK) {
+        i2c_master_bus_rm_device(dev->handle);
+        ESP_RETURN_ON_ERROR(ret, TAG, "i2c_master_register_event_callbacks");
+    }
+#endif
+
+    return ESP_OK;
+}
+
+void sht4x_bus_remove(sht4x_bus_dev_t *dev)
+{
+    i2c_master_bus_rm_device(dev->handle);
+}
+
+#if SHT4X_BUS_ASYNC
+
+esp_err_t sht4x_bus_write_async(sht4x_bus_dev_t *dev, const uint8_t *data, size_t len,
+                                sht4x_async_t *async, esp_err_t *result)
+{
+    esp_err_t ret;
+
+    if (atomic_load(&dev->sync.pending) > 0) {
+        return ESP_ERR_TIMEOUT; // a timed-out transfer is still in flight
+    }
+
+    dev->async = async;
+    dev->result = result;
+    atomic_fetch_add(&async->pending, 1);
+
+    ret = i2c_master_transmit(dev->handle, data, len, -1);
+    if (ret != ESP_OK) {
+        atomic_fetch_sub(&async->pending, 1);
+    }
+
+    return map_error(ret);
+}
+
+esp_err_t sht4x_bus_read_async(sht4x_bus_dev_t *dev, uint8_t *data, size_t len,
+                               sht4x_async_t *async, esp_err_t *result)
+{
+    esp_err_t ret;
+
+    if (atomic_load(&dev->sync.pending) > 0) {
+        return ESP_ERR_TIMEOUT; // a timed-out transfer is still in flight
+    }
+
+    dev->async = async;
+    dev->result = result;
+    atomic_fetch_add(&async->pending, 1);
+
+    ret = i2c_master_receive(dev->handle, data, len, -1);
+    if (ret != ESP_OK) {
+        atomic_fetch_sub(&async->pending, 1);
+    }
+
+    return map_error(ret);
+}
+
+esp_err_t sht4x_bus_write(sht4x_bus_dev_t *dev, const uint8_t *data, size_t len,
+                          TickType_t ticks)
+{
+    if (len > sizeof(dev->sync_data)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    memcpy(dev->sync_data, data, len);
+    ESP_RETURN_ON_ERROR(sht4x_bus_write_async(dev, dev->sync_data, len, &dev->sync,
+                                              &dev->sync_result),
+                        TAG, "sht4x_bus_write_async");
+
+    return async_wait(&dev->sync, ticks) ? dev->sync_result : ESP_ERR_TIMEOUT;
+}
+
+esp_err_t sht4x_bus_read(sht4x_bus_dev_t *dev, uint8_t *data, size_t len,
+                         TickType_t ticks)
+{
+    if (len > sizeof(dev->sync_data)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    ESP_RETURN_ON_ERROR(sht4x_bus_read_async(dev, dev->sync_data, len, &dev->sync,
+                                             &dev->sync_result),
+                        TAG, "sht4x_bus_read_async");
+
+    if (!async_wait(&dev->sync, ticks)) {
+        return ESP_ERR_TIMEOUT;
+    }
+
+    if (dev->sync_result == ESP_OK) {
+        memcpy(data, dev->sync_data, len);
+    }
+
+    return dev->sync_result;
+}
+
+#else
+
+/** Timeout (ms) of the bus/device driver corresponding to `ticks`. */
+static int timeout_ms(TickType_t ticks)
+{
+    return (ticks == portMAX_DELAY) ? -1 : (int)(ticks * portTICK_PERIOD_MS);
+}
+
+esp_err_t sht4x_bus_write(sht4x_bus_dev_t *dev, const uint8_t *data, size_t len,
+                          TickType_t ticks)
+{
+    return map_error(i2c_master_transmit(dev->handle, data, len, timeout_ms(ticks)));
+}
+
+esp_err_t sht4x_bus_read(sht4x_bus_dev_t *dev, uint8_t *data, size_t len,
+                         TickType_t ticks)
+{
+    return map_error(i2c_master_receive(dev->handle, data, len, timeout_ms(ticks)));
+}
+
+#endif
+
+#else // legacy driver
+
+esp_err_t sht4x_bus_add(sht4x_bus_dev_t *dev, i2c_port_t port, uint8_t address)
+{
+    dev->port = port;
+    dev->address = address;
+    return ESP_OK;
+}
+
+void sht4x_bus_remove(sht4x_bus_dev_t *dev)
+{
+    (void)dev;
+}
+
+esp_err_t sht4x_bus_write(sht4x_bus_dev_t *dev, const uint8_t *data, size_t len,
+                          TickType_t ticks)
+{
+    return i2c_master_write_to_device(dev->port, dev->address, data, len, ticks);
+}
+
+esp_err_t sht4x_bus_read(sht4x_bus_dev_t *dev, uint8_t *data, size_t len,
+                         TickType_t ticks)
+{
+    return i2c_master_read_from_device(dev->port, dev->address, data, len, ticks);
+}
+
+#endif
@@ -0,0 +1,107 @@
+/**
+ * @file sht4x_bus.h
+ *
+ * I2C backends of the SHT4x driver: the legacy driver (driver/i2c.h)
+ * or the bus/device driver (driver/i2c_master.h), selected by
+ * CONFIG_SHT4X_I2C_BACKEND.
+ *
+ * Both backends report a missing acknowledge as ESP_FAIL.
+ */
+
+#pragma once
+
+#include "sdkconfig.h"
+#include "esp_err.h"
+
+#if CONFIG_SHT4X_I2C_MASTER
+#include "driver/i2c_master.h"
+#else
+#include "driver/i2c.h"
+#endif
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include <stdatomic.h>
+
+/** Transfers complete asynchronously through callbacks. */
+#if CONFIG_SHT4X_I2C_MASTER_ASYNC
+#define SHT4X_BUS_ASYNC 1
+#else
+#define SHT4X_BUS_ASYNC 0
+#endif
+
+/** Group of asynchronous transfers, completed together. */
+typedef struct {
+    atomic_int pending; // transfers not yet complete
+#if SHT4X_BUS_ASYNC
+    SemaphoreHandle_t done; // given when the last pending transfer completes
+    StaticSemaphore_t done_buffer;
+#endif
+} sht4x_async_t;
+
+/** I2C device. */
+typedef struct {
+    i2c_port_t port;
+    uint8_t address;
+#if CONFIG_SHT4X_I2C_MASTER
+    i2c_master_dev_handle_t handle;
+#endif
+#if SHT4X_BUS_ASYNC
+    sht4x_async_t *async; // group of the transfer in flight
+    esp_err_t *result; // result of the transfer in flight
+    sht4x_async_t sync; // group of blocking transfers
+    esp_err_t sync_result;
+    uint8_t sync_data[6]; // data of blocking transfers, which may outlive their timeout
+#endif
+} sht4x_bus_dev_t;
+
+/**
+ * Add device at `address` on (the bus of) `port`.
+ *
+ * With the bus/device driver, the bus of `port` must have been created
+ * with i2c_new_master_bus(), and with `trans_queue_depth` > 0 if
+ * transfers are asynchronous.
+ */
+esp_err_t sht4x_bus_add(sht4x_bus_dev_t *dev, i2c_port_t port, uint8_t address);
+
+/** Remove device. */
+void sht4x_bus_remove(sht4x_bus_dev_t *dev);
+
+/** Write data to device; wait at most `ticks` for the bus and transfer. */
+esp_err_t sht4x_bus_write(sht4x_bus_dev_t *dev, const uint8_t *data, size_t len,
+                          TickType_t ticks);
+
+/** Read data from device; wait at most `ticks` for the bus and transfer. */
+esp_err_t sht4x_bus_read(sht4x_bus_dev_t *dev, uint8_t *data, size_t len,
+                         TickType_t ticks);
+
+/** Initialize empty group of asynchronous transfers. */
+void sht4x_async_init(sht4x_async_t *async);
+
+/** Wait until all transfers of the group are complete. */
+void sht4x_async_wait(sht4x_async_t *async);
+
+#if SHT4X_BUS_ASYNC
+/**
+ * Queue write to device as part of `async`.
+ *
+ * `data` must stay valid, and only one transfer per device may be in
+ * flight, until the group is complete; `result` is then set. Fails
+ * with ESP_ERR_TIMEOUT while a timed-out blocking transfer is still
+ * in flight.
+ */
+esp_err_t sht4x_bus_write_async(sht4x_bus_dev_t *dev, const uint8_t *data, size_t len,
+                                sht4x_async_t *async, esp_err_t *result);
+
+/**
+ * Queue read from device as part of `async`.
+ *
+ * `data` must stay valid, and only one transfer per device may be in
+ * flight, until the group is complete; `result` is then set. Fails
+ * with ESP_ERR_TIMEOUT while a timed-out blocking transfer is still
+ * in flight.
+ */
+esp_err_t sht4x_bus_read_async(sht4x_bus_dev_t *dev, uint8_t *data, size_t len,
+                               sht4x_async_t *async, esp_err_t *result);
+#endif
@@ -0,0 +1,51 @@
+/**
+ * @file sht4x_convert.c
+ *
+ * Batch conversion of raw SHT4x data to temperature and humidity.
+ *
+ * The loops are branch-free and operate on restrict-qualified arrays,
+ * so that the compiler can vectorize them.
+ */
+
+#include "sht4x_convert.h"
+#include "sht4x_priv.h"
+
+#if CONFIG_SHT4X_FLOAT_API
+void sht4x_convert(const uint16_t *restrict temperature_raw,
+                   const uint16_t *restrict humidity_raw, size_t n,
+                   float *restrict temperature, float *restrict humidity)
+{
+    if (temperature_raw && temperature) {
+        for (size_t i = 0; i < n; ++i) {
+            temperature[i] = -45.0f + (175.0f / 65535.0f) * temperature_raw[i];
+        }
+    }
+
+    if (humidity_raw && humidity) {
+        for (size_t i = 0; i < n; ++i) {
+            float rh = -6.0f + (125.0f / 65535.0f) * humidity_raw[i];
+
+            // crop humidity to [0, 100]; see datasheet § 4.5
+            rh = (rh > 100.0f) ? 100.0f : rh;
+            humidity[i] = (rh < 0.0f) ? 0.0f : rh;
+        }
+    }
+}
+#endif
+
+void sht4x_convert_fixed(const uint16_t *restrict temperature_raw,
+                         const uint16_t *restrict humidity_raw, size_t n,
+                         int32_t *restrict temperature, int32_t *restrict humidity)
+{
+    if (temperature_raw && temperature) {
+        for (size_t i = 0; i < n; ++i) {
+            temperature[i] = sht4x_raw_to_temperature_fixed(temperature_raw[i]);
+        }
+    }
+
+    if (humidity_raw && humidity) {
+        for (size_t i = 0; i < n; ++i) {
+            humidity[i] = sht4x_raw_to_relative_humidity_fixed(humidity_raw[i]);
+        }
+    }
+}
@@ -0,0 +1,121 @@
+/**
+ * @file sht4x_crc.c
+ *
+ * CRC-8 checksum (polynomial 0x31, initialization 0xff) of SHT4x data.
+ */
+
+#include "sht4x_crc.h"
+
+#include "sdkconfig.h"
+#include "esp_attr.h"
+
+#define G_POLYNOM 0x31
+
+#if CONFIG_SHT4X_CRC_TABLE_IN_DRAM
+#define CRC8_TABLE_ATTR DRAM_ATTR
+#else
+#define CRC8_TABLE_ATTR
+#endif
+
+/*
+ * The lookup tables are generated by the preprocessor. The CRC
+ * register update is linear, so each table entry is the XOR of the
+ * entries for its set bits, which are computed (one bit at a time)
+ * only once.
+ */
+
+#define CRC8_STEP1(x) ((((x) << 1) ^ (((x) & 0x80) ? G_POLYNOM : 0)) & 0xff)
+#define CRC8_STEP4(x) CRC8_STEP1(CRC8_STEP1(CRC8_STEP1(CRC8_STEP1(x))))
+#define CRC8_STEP8(x) CRC8_STEP4(CRC8_STEP4(x))
+
+enum {
+    CRC8_B0 = CRC8_STEP8(0x01),
+    CRC8_B1 = CRC8_STEP8(0x02),
+    CRC8_B2 = CRC8_STEP8(0x04),
+    CRC8_B3 = CRC8_STEP8(0x08),
+    CRC8_B4 = CRC8_STEP8(0x10),
+    CRC8_B5 = CRC8_STEP8(0x20),
+    CRC8_B6 = CRC8_STEP8(0x40),
+    CRC8_B7 = CRC8_STEP8(0x80),
+    CRC8_N0 = CRC8_STEP4(0x10),
+    CRC8_N1 = CRC8_STEP4(0x20),
+    CRC8_N2 = CRC8_STEP4(0x40),
+    CRC8_N3 = CRC8_STEP4(0x80),
+};
+
+#define CRC8_BIT(v, k, entry) (((v) & (1 << (k))) ? (entry) : 0)
+
+#define CRC8_NIBBLE(n)                                                          \
+    (CRC8_BIT(n, 0, CRC8_N0) ^ CRC8_BIT(n, 1, CRC8_N1) ^ CRC8_BIT(n, 2, CRC8_N2) ^ \
+     CRC8_BIT(n, 3, CRC8_N3))
+
+#define CRC8_BYTE(b)                                                            \
+    (CRC8_BIT(b, 0, CRC8_B0) ^ CRC8_BIT(b, 1, CRC8_B1) ^ CRC8_BIT(b, 2, CRC8_B2) ^ \
+     CRC8_BIT(b, 3, CRC8_B3) ^ CRC8_BIT(b, 4, CRC8_B4) ^ CRC8_BIT(b, 5, CRC8_B5) ^ \
+     CRC8_BIT(b, 6, CRC8_B6) ^ CRC8_BIT(b, 7, CRC8_B7))
+
+#define CRC8_ROW4(f, n) f(n), f(n + 1), f(n + 2), f(n + 3)
+#define CRC8_ROW16(f, n)                                                        \
+    CRC8_ROW4(f, n), CRC8_ROW4(f, n + 4), CRC8_ROW4(f, n + 8), CRC8_ROW4(f, n + 12)
+#define CRC8_ROW64(f, n)                                                        \
+    CRC8_ROW16(f, n), CRC8_ROW16(f, n + 16), CRC8_ROW16(f, n + 32),             \
+        CRC8_ROW16(f, n + 48)
+
+/** CRC of high nibble `n`: CRC8_STEP4(n << 4). */
+static const CRC8_TABLE_ATTR uint8_t crc8_nibble_table[16] = {
+    CRC8_ROW16(CRC8_NIBBLE, 0)};
+
+/** CRC of byte `b`: CRC8_STEP8(b). */
+static const CRC8_TABLE_ATTR uint8_t crc8_byte_table[256] = {
+    CRC8_ROW64(CRC8_BYTE, 0), CRC8_ROW64(CRC8_BYTE, 64), CRC8_ROW64(CRC8_BYTE, 128),
+    CRC8_ROW64(CRC8_BYTE, 192)};
+
+uint8_t sht4x_crc8_bitwise(const uint8_t *data, size_t len)
+{
+    uint8_t crc = 0xff;
+
+    for (size_t i = 0; i < len; ++i) {
+        crc ^= data[i];
+
+        for (int k = 0; k < 8; ++k) {
+            crc = crc & 0x80 ? (crc << 1) ^ G_POLYNOM : crc << 1;
+        }
+    }
+
+    return crc;
+}
+
+uint8_t sht4x_crc8_nibble(const uint8_t *data, size_t len)
+{
+    uint8_t crc = 0xff;
+
+    for (size_t i = 0; i < len; ++i) {
+        crc ^= data[i];
+        crc = (uint8_t)(crc << 4) ^ crc8_nibble_table[crc >> 4];
+        crc = (uint8_t)(crc << 4) ^ crc8_nibble_table[crc >> 4];
+    }
+
+    return crc;
+}
+
+uint8_t sht4x_crc8_table(const uint8_t *data, size_t len)
+{
+    uint8_t crc = 0xff;
+
+    for (size_t i = 0; i < len; ++i) {
+        crc = crc8_byte_table[crc ^ data[i]];
+    }
+
+    return crc;
+}
+
+uint8_t sht4x_crc8(const uint8_t *data, size_t len)
+{
+#if CONFIG_SHT4X_CRC_TABLE
+    return sht4x_crc8_table(data, len);
+#elif CONFIG_SHT4X_CRC_NIBBLE
+    return sht4x_crc8_nibble(data, len);
+#else
+    return sht4x_crc8_bitwise(data, len);
+#endif
+}
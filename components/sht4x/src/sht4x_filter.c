@@ -0,0 +1,173 @@
+/**
+ * @file sht4x_filter.c
+ *
+ * Incremental filters of raw SHT4x data.
+ */
+
+#include "sht4x_filter.h"
+
+#include <string.h>
+
+esp_err_t sht4x_filter_init(sht4x_filter_t *filter, const sht4x_filter_config_t *config)
+{
+    switch (config->type) {
+    case SHT4X_FILTER_NONE:
+        break;
+
+    case SHT4X_FILTER_EWMA:
+        if (config->shift < 1 || config->shift > 8) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        break;
+
+    case SHT4X_FILTER_MEAN:
+    case SHT4X_FILTER_MEDIAN:
+        if (config->window < 1 || config->window > SHT4X_FILTER_MAX_WINDOW) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        break;
+
+    default:
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    filter->type = config->type;
+    filter->shift = config->shift;
+    filter->window = config->window;
+    filter->count = 0;
+    filter->next = 0;
+    filter->state = 0;
+    return ESP_OK;
+}
+
+esp_err_t sht4x_filter_restore(sht4x_filter_t *filter, const sht4x_filter_t *saved)
+{
+    const sht4x_filter_config_t config = {
+        .type = saved->type, .shift = saved->shift, .window = saved->window};
+    sht4x_filter_t restored;
+
+    if (sht4x_filter_init(&restored, &config) != ESP_OK) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    switch (saved->type) {
+    case SHT4X_FILTER_EWMA:
+        if (saved->count > 1 || saved->state < 0 || saved->state > (0xffff << 8)) {
+            return ESP_ERR_INVALID_ARG;
+        }
+
+        restored.count = saved->count;
+        restored.state = saved->count ? saved->state : 0;
+        break;
+
+    case SHT4X_FILTER_MEAN:
+    case SHT4X_FILTER_MEDIAN:
+        // the window fills from ring[0]; once full, `next` is its oldest value
+        if (saved->count > saved->window || saved->next >= saved->window ||
+            (saved->count < saved->window && saved->next != saved->count)) {
+            return ESP_ERR_INVALID_ARG;
+        }
+
+        for (size_t i = 0; i < saved->count; ++i) {
+            const uint16_t value = saved->ring[i];
+            size_t j;
+
+            for (j = i; j > 0 && restored.sorted[j - 1] > value; --j) {
+                restored.sorted[j] = restored.sorted[j - 1];
+            }
+
+            restored.sorted[j] = value;
+            restored.ring[i] = value;
+            restored.state += value;
+        }
+
+        restored.count = saved->count;
+        restored.next = saved->next;
+        break;
+
+    default:
+        break;
+    }
+
+    *filter = restored;
+    return ESP_OK;
+}
+
+/** Exponentially weighted moving average. */
+static uint16_t update_ewma(sht4x_filter_t *filter, uint16_t value)
+{
+    const int32_t x = (int32_t)value << 8;
+
+    if (!filter->count) {
+        filter->state = x;
+        filter->count = 1;
+    } else {
+        // arithmetic shift: the state moves towards x from either side
+        filter->state += (x - filter->state) >> filter->shift;
+    }
+
+    return (filter->state + 0x80) >> 8;
+}
+
+/** Moving average. */
+static uint16_t update_mean(sht4x_filter_t *filter, uint16_t value)
+{
+    if (filter->count == filter->window) {
+        filter->state -= filter->ring[filter->next];
+    } else {
+        ++filter->count;
+    }
+
+    filter->state += value;
+    filter->ring[filter->next] = value;
+    filter->next = (filter->next + 1) % filter->window;
+
+    return (filter->state + filter->count / 2) / filter->count;
+}
+
+/** Moving median. */
+static uint16_t update_median(sht4x_filter_t *filter, uint16_t value)
+{
+    uint16_t *sorted = filter->sorted;
+    size_t n = filter->count, i;
+
+    // drop the oldest value from the sorted window...
+    if (n == filter->window) {
+        const uint16_t oldest = filter->ring[filter->next];
+
+        for (i = 0; sorted[i] != oldest; ++i) {
+        }
+
+        memmove(&sorted[i], &sorted[i + 1], (n - i - 1) * sizeof(sorted[0]));
+        --n;
+    }
+
+    // ... and insert the new one
+    for (i = n; i > 0 && sorted[i - 1] > value; --i) {
+        sorted[i] = sorted[i - 1];
+    }
+
+    sorted[i] = value;
+    filter->count = ++n;
+    filter->ring[filter->next] = value;
+    filter->next = (filter->next + 1) % filter->window;
+
+    return (n % 2) ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2] + 1) / 2;
+}
+
+uint16_t sht4x_filter_update(sht4x_filter_t *filter, uint16_t value)
+{
+    switch (filter->type) {
+    case SHT4X_FILTER_EWMA:
+        return update_ewma(filter, value);
+
+    case SHT4X_FILTER_MEAN:
+        return update_mean(filter, value);
+
+    case SHT4X_FILTER_MEDIAN:
+        return update_median(filter, value);
+
+    default:
+        return value;
+    }
+}
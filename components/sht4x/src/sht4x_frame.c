@@ -0,0 +1,71 @@
+/**
+ * @file sht4x_frame.c
+ *
+ * Compact binary frames of timestamped raw measurements.
+ */
+
+#include "sht4x_frame.h"
+#include "sht4x_crc.h"
+
+// frames are serialized field by field, independent of the layout of
+// sht4x_sample_t: sync, flags, sensor ID, payload, CRC
+_Static_assert(SHT4X_FRAME_KEY_LEN == 3 + sizeof(uint32_t) + 2 * sizeof(uint16_t) + 1,
+               "key frame: ms timestamp, raw temperature and humidity");
+_Static_assert(SHT4X_FRAME_DELTA_LEN == 3 + sizeof(uint16_t) + 2 * sizeof(int8_t) + 1,
+               "delta frame: ms time step, temperature and humidity steps");
+
+void sht4x_frame_encoder_init(sht4x_frame_encoder_t *encoder, uint8_t sensor_id,
+                              bool delta)
+{
+    encoder->sensor_id = sensor_id;
+    encoder->delta = delta;
+    encoder->count = 0;
+}
+
+/** Store 16-bit value in little endian. */
+static uint8_t *put16(uint8_t *p, uint16_t value)
+{
+    *p++ = value;
+    *p++ = value >> 8;
+    return p;
+}
+
+size_t sht4x_frame_encode(sht4x_frame_encoder_t *encoder, const sht4x_sample_t *sample,
+                          uint8_t *frame)
+{
+    const uint32_t timestamp = sample->timestamp / 1000;
+    const uint32_t dt = timestamp - encoder->timestamp;
+    const int32_t dtemp = (int32_t)sample->temperature - encoder->temperature;
+    const int32_t drh = (int32_t)sample->humidity - encoder->humidity;
+    uint8_t *p = frame;
+    bool delta;
+
+    delta = encoder->delta && encoder->count && encoder->count < SHT4X_FRAME_KEY_INTERVAL &&
+            dt <= UINT16_MAX && dtemp >= INT8_MIN && dtemp <= INT8_MAX &&
+            drh >= INT8_MIN && drh <= INT8_MAX;
+
+    *p++ = SHT4X_FRAME_SYNC;
+    *p++ = delta ? SHT4X_FRAME_DELTA : 0;
+    *p++ = encoder->sensor_id;
+
+    if (delta) {
+        p = put16(p, dt);
+        *p++ = (int8_t)dtemp;
+        *p++ = (int8_t)drh;
+        ++encoder->count;
+    } else {
+        p = put16(p, timestamp);
+        p = put16(p, timestamp >> 16);
+        p = put16(p, sample->temperature);
+        p = put16(p, sample->humidity);
+        encoder->count = 1;
+    }
+
+    *p = sht4x_crc8(&frame[1], p - &frame[1]);
+
+    encoder->timestamp = timestamp;
+    encoder->temperature = sample->temperature;
+    encoder->humidity = sample->humidity;
+
+    return p + 1 - frame;
+}
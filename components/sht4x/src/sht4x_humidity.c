@@ -0,0 +1,283 @@
+/**
+ * @file sht4x_humidity.c
+ *
+ * Dew point, absolute humidity and vapor pressure deficit.
+ *
+ * Both forms split the Magnus formula into f(T) = 17.62 * T / (243.12
+ * + T), ln(RH / 100) = ln(2) * log2(RH / 100) and exp(x) = exp2(x *
+ * log2(e)). Logarithms and exponentials of base 2 reduce to their
+ * mantissa on [1, 2) (or [0, 1)) by exponent arithmetic, where a
+ * polynomial (float) or an interpolation table (fixed point) takes
+ * over.
+ */
+
+#include "sht4x_humidity.h"
+#include "sht4x_priv.h"
+
+#include <string.h>
+
+#define MAGNUS_B 17.62f
+#define MAGNUS_C 243.12f
+#define MIN_HUMIDITY 1.0f // %RH
+
+#if CONFIG_SHT4X_FLOAT_API
+/** log2(x) for x > 0; max. error 1.5e-5. */
+static inline float fast_log2f(float x)
+{
+    uint32_t bits;
+    float u;
+    int e;
+
+    memcpy(&bits, &x, sizeof(bits));
+    e = (int)(bits >> 23) - 127;
+    bits = (bits & 0x007fffff) | 0x3f800000; // mantissa in [1, 2)
+    memcpy(&u, &bits, sizeof(u));
+    u -= 1.0f;
+
+    // minimax polynomial of log2(1 + u) on [0, 1)
+    return e + u * (1.44196561f +
+                    u * (-0.70966279f +
+                         u * (0.41759568f + u * (-0.19626951f + u * 0.04638531f))));
+}
+
+/** 2^x for x in (-126, 128); max. relative error 3.8e-6. */
+static inline float fast_exp2f(float x)
+{
+    int k = (int)x;
+    uint32_t bits;
+    float scale, u;
+
+    k -= (x < k); // floor
+    u = x - k;
+    bits = (uint32_t)(k + 127) << 23;
+    memcpy(&scale, &bits, sizeof(scale));
+
+    // minimax polynomial of 2^u on [0, 1)
+    return scale * (1.00000370f +
+                    u * (0.69296612f + u * (0.24163844f + u * (0.05169036f + u * 0.01369766f))));
+}
+
+/** 17.62 * T / (243.12 + T). */
+static inline float magnus_exponent(float temperature)
+{
+    return MAGNUS_B * temperature / (MAGNUS_C + temperature);
+}
+
+/** Saturation vapor pressure (hPa). */
+static inline float saturation_pressure(float temperature)
+{
+    return 6.112f * fast_exp2f(1.44269504f * magnus_exponent(temperature));
+}
+
+static inline float clamp_humidity(float humidity)
+{
+    return (humidity < MIN_HUMIDITY) ? MIN_HUMIDITY : humidity;
+}
+
+float sht4x_dew_point(float temperature, float humidity)
+{
+    const float g = 0.69314718f * fast_log2f(clamp_humidity(humidity) / 100.0f) +
+                    magnus_exponent(temperature);
+
+    return MAGNUS_C * g / (MAGNUS_B - g);
+}
+
+float sht4x_absolute_humidity(float temperature, float humidity)
+{
+    const float e = clamp_humidity(humidity) / 100.0f * saturation_pressure(temperature);
+
+    return 216.7f * e / (273.15f + temperature);
+}
+
+float sht4x_vapor_pressure_deficit(float temperature, float humidity)
+{
+    // hPa to kPa
+    return saturation_pressure(temperature) * (100.0f - clamp_humidity(humidity)) / 1000.0f;
+}
+
+void sht4x_derive(const float *temperature, const float *humidity, size_t n,
+                  float *dew_point, float *absolute_humidity, float *vpd)
+{
+    // one branch-free loop per output, so that each can be vectorized
+    if (dew_point) {
+        for (size_t i = 0; i < n; ++i) {
+            dew_point[i] = sht4x_dew_point(temperature[i], humidity[i]);
+        }
+    }
+
+    if (absolute_humidity) {
+        for (size_t i = 0; i < n; ++i) {
+            absolute_humidity[i] = sht4x_absolute_humidity(temperature[i], humidity[i]);
+        }
+    }
+
+    if (vpd) {
+        for (size_t i = 0; i < n; ++i) {
+            vpd[i] = sht4x_vapor_pressure_deficit(temperature[i], humidity[i]);
+        }
+    }
+}
+#endif
+
+/** 17.62 * T / (243.12 + T) (Q16) at raw temperature i * 512. */
+static const int32_t MAGNUS_EXPONENT[129] = {
+    -262283, -252571, -242992, -233542, -224219, -215020, -205943, -196986,
+    -188146, -179420, -170808, -162306, -153912, -145624, -137441, -129361,
+    -121380, -113498, -105713, -98023, -90427, -82921, -75506, -68179,
+    -60939, -53784, -46713, -39724, -32816, -25987, -19237, -12563,
+    -5965, 560, 7011, 13390, 19699, 25939, 32110, 38215,
+    44253, 50226, 56136, 61982, 67767, 73491, 79154, 84759,
+    90306, 95795, 101228, 106606, 111929, 117198, 122414, 127578,
+    132691, 137753, 142765, 147728, 152642, 157509, 162329, 167102,
+    171830, 176512, 181150, 185745, 190296, 194805, 199271, 203697,
+    208081, 212426, 216730, 220996, 225223, 229411, 233563, 237677,
+    241754, 245796, 249801, 253772, 257708, 261610, 265478, 269312,
+    273114, 276883, 280620, 284325, 287999, 291643, 295255, 298838,
+    302391, 305914, 309409, 312874, 316312, 319721, 323103, 326458,
+    329786, 333087, 336361, 339610, 342833, 346031, 349203, 352351,
+    355474, 358573, 361649, 364700, 367728, 370733, 373715, 376674,
+    379612, 382527, 385420, 388291, 391142, 393971, 396779, 399567,
+    402334,
+};
+
+/** log2(1 + i / 64) (Q16). */
+static const int32_t LOG2[65] = {
+    0,     1466,  2909,  4331,  5732,  7112,  8473,  9814,  11136, 12440, 13727,
+    14996, 16248, 17484, 18704, 19909, 21098, 22272, 23433, 24579, 25711, 26830,
+    27936, 29029, 30109, 31178, 32234, 33279, 34312, 35334, 36346, 37346, 38336,
+    39316, 40286, 41246, 42196, 43137, 44068, 44990, 45904, 46809, 47705, 48593,
+    49472, 50344, 51207, 52063, 52911, 53751, 54584, 55410, 56229, 57040, 57845,
+    58643, 59434, 60219, 60997, 61769, 62534, 63294, 64047, 64794, 65536,
+};
+
+/** 2^(i / 64) (Q30). */
+static const uint32_t EXP2[65] = {
+    1073741824, 1085434106, 1097253708, 1109202018, 1121280436, 1133490379,
+    1145833280, 1158310587, 1170923762, 1183674286, 1196563654, 1209593378,
+    1222764986, 1236080024, 1249540052, 1263146652, 1276901417, 1290805962,
+    1304861917, 1319070932, 1333434672, 1347954824, 1362633090, 1377471191,
+    1392470869, 1407633882, 1422962010, 1438457051, 1454120821, 1469955159,
+    1485961921, 1502142985, 1518500250, 1535035634, 1551751076, 1568648537,
+    1585730000, 1602997467, 1620452965, 1638098541, 1655936265, 1673968228,
+    1692196547, 1710623359, 1729250827, 1748081133, 1767116489, 1786359126,
+    1805811301, 1825475297, 1845353420, 1865448001, 1885761398, 1906295993,
+    1927054196, 1948038440, 1969251188, 1990694927, 2012372174, 2034285470,
+    2056437387, 2078830522, 2101467502, 2124350982, 2147483648,
+};
+
+#define MAGNUS_B_Q16 1154744 // 17.62
+#define MAGNUS_C_MILLI 243120 // 243.12 °C
+#define LN2_Q16 45426
+#define LOG2E_Q16 94548
+#define LOG2_100_PERCENT_Q16 1483986 // log2(100 * 65535)
+#define RH_MIN 65535 // 1 %RH
+#define RH_MAX 6553500 // 100 %RH
+
+/** Linear interpolation in table of 2^(16 - shift) intervals at 16-bit position `x`. */
+static inline int32_t interpolate(const int32_t *table, int shift, uint32_t x)
+{
+    const uint32_t i = x >> shift, frac = x & ((1u << shift) - 1);
+
+    return table[i] + (int32_t)(((int64_t)(table[i + 1] - table[i]) * frac) >> shift);
+}
+
+/** 17.62 * T / (243.12 + T) (Q16). */
+static inline int32_t magnus_exponent_fixed(uint16_t temperature_raw)
+{
+    return interpolate(MAGNUS_EXPONENT, 9, temperature_raw);
+}
+
+/**
+ * Relative humidity in units of 1/65535 %RH, clamped to [1, 100] %RH.
+ *
+ * This is exact, unlike m%RH, which would be off by up to 0.05 % (and
+ * the dew point by up to 0.01 °C) at 1 %RH.
+ */
+static inline int32_t humidity_fixed(uint16_t humidity_raw)
+{
+    const int32_t rh = 125 * (int32_t)humidity_raw - 6 * 65535;
+
+    return (rh < RH_MIN) ? RH_MIN : (rh > RH_MAX) ? RH_MAX : rh;
+}
+
+/** ln(RH / 100) (Q16) of relative humidity in units of 1/65535 %RH. */
+static inline int32_t log_humidity_fixed(int32_t rh)
+{
+    const int msb = 31 - __builtin_clz(rh);
+    const uint32_t m = (uint32_t)rh << (31 - msb); // leading one at bit 31
+
+    // log2(rh) = msb + log2(mantissa), mantissa bits 30..15 interpolated
+    const int32_t log2_rh = (msb << 16) + interpolate(LOG2, 10, (m >> 15) & 0xffff);
+
+    return (int32_t)(((int64_t)(log2_rh - LOG2_100_PERCENT_Q16) * LN2_Q16) >> 16);
+}
+
+/** Saturation vapor pressure (mPa) from Magnus exponent (Q16). */
+static inline int64_t saturation_pressure_fixed(int32_t x)
+{
+    const int32_t y = (int32_t)(((int64_t)x * LOG2E_Q16) >> 16); // log2 (Q16)
+    const int k = y >> 16; // floor
+    const uint32_t u = y & 0xffff;
+    const uint32_t i = u >> 10, frac = u & 0x3ff;
+    const uint64_t p = EXP2[i] + (((uint64_t)(EXP2[i + 1] - EXP2[i]) * frac) >> 10);
+
+    // 611.2 Pa * 2^k * 2^u, with 2^u in Q30 and k in [-6, 9]
+    return (int64_t)((611200 * p) >> (30 - k));
+}
+
+int32_t sht4x_dew_point_fixed(uint16_t temperature_raw, uint16_t humidity_raw)
+{
+    const int32_t g = log_humidity_fixed(humidity_fixed(humidity_raw)) +
+                      magnus_exponent_fixed(temperature_raw);
+
+    return (int32_t)((int64_t)MAGNUS_C_MILLI * g / (MAGNUS_B_Q16 - g));
+}
+
+int32_t sht4x_absolute_humidity_fixed(uint16_t temperature_raw, uint16_t humidity_raw)
+{
+    const int64_t es = saturation_pressure_fixed(magnus_exponent_fixed(temperature_raw));
+    const int64_t e = es * humidity_fixed(humidity_raw) / RH_MAX;
+    const int32_t t = sht4x_raw_to_temperature_fixed(temperature_raw) + 273150; // mK
+
+    // 216.7 * e (hPa) / T (K) g/m³ = 2167 * e (mPa) / T (mK) mg/m³
+    return (int32_t)((2167 * e + t / 2) / t);
+}
+
+int32_t sht4x_vapor_pressure_deficit_fixed(uint16_t temperature_raw, uint16_t humidity_raw)
+{
+    const int64_t es = saturation_pressure_fixed(magnus_exponent_fixed(temperature_raw));
+
+    // mPa to Pa
+    return (int32_t)((es * (RH_MAX - humidity_fixed(humidity_raw)) + 500LL * RH_MAX) /
+                     (1000LL * RH_MAX));
+}
+
+void sht4x_derive_fixed(const uint16_t *temperature_raw, const uint16_t *humidity_raw,
+                        size_t n, int32_t *dew_point, int32_t *absolute_humidity,
+                        int32_t *vpd)
+{
+    for (size_t i = 0; i < n; ++i) {
+        const int32_t x = magnus_exponent_fixed(temperature_raw[i]);
+        const int32_t rh = humidity_fixed(humidity_raw[i]);
+
+        if (dew_point) {
+            const int32_t g = log_humidity_fixed(rh) + x;
+
+            dew_point[i] = (int32_t)((int64_t)MAGNUS_C_MILLI * g / (MAGNUS_B_Q16 - g));
+        }
+
+        if (absolute_humidity || vpd) {
+            const int64_t es = saturation_pressure_fixed(x);
+
+            if (absolute_humidity) {
+                const int32_t t = sht4x_raw_to_temperature_fixed(temperature_raw[i]) + 273150;
+
+                absolute_humidity[i] = (int32_t)((2167 * (es * rh / RH_MAX) + t / 2) / t);
+            }
+
+            if (vpd) {
+                vpd[i] = (int32_t)((es * (RH_MAX - rh) + 500LL * RH_MAX) / (1000LL * RH_MAX));
+            }
+        }
+    }
+}
@@ -0,0 +1,106 @@
+/**
+ * @file sht4x_priv.h
+ *
+ * Internal functions shared by the SHT4x driver modules.
+ */
+
+#pragma once
+
+#include "sdkconfig.h"
+#include "sht4x.h"
+#include "sht4x_bus.h"
+
+#include <stdint.h>
+
+/**
+ * Sleep until (at least) time `t` (µs, see esp_timer_get_time()).
+ *
+ * The resolution depends on CONFIG_SHT4X_WAIT: whole ticks when
+ * sleeping, or µs when woken by the shared esp_timer.
+ */
+void sht4x_sleep_until(int64_t t);
+
+/**
+ * Split measurement, for issuing the transfers of many sensors at once.
+ *
+ * sht4x_start_measure_async() queues the measurement command as part of
+ * `async` and, on success, holds the handle until
+ * sht4x_start_measure_finish() is called after sht4x_async_wait();
+ * this returns the result of the transfer and the time (µs) after
+ * which the result may be fetched.
+ *
+ * Likewise, sht4x_fetch_measure_async() queues the read of a started
+ * measurement, and sht4x_fetch_measure_finish() returns the
+ * measurement, or ESP_ERR_NOT_FINISHED while polling a sensor that is
+ * not ready yet.
+ *
+ * Each finish call must be made by the task that made the matching
+ * async call, since it gives back the handle lock taken there; it
+ * returns ESP_ERR_INVALID_STATE otherwise, or without a matching async
+ * call. sht4x_start_measure_async() returns ESP_ERR_INVALID_STATE while
+ * a measurement is pending, like sht4x_start_measure().
+ *
+ * With the legacy I2C driver, transfers complete synchronously and
+ * `async` is unused.
+ */
+esp_err_t sht4x_start_measure_async(sht4x_t sht4x, sht4x_heat_t heat, sht4x_async_t *async);
+esp_err_t sht4x_start_measure_finish(sht4x_t sht4x, int64_t *fetch);
+esp_err_t sht4x_fetch_measure_async(sht4x_t sht4x, sht4x_async_t *async);
+esp_err_t sht4x_fetch_measure_finish(sht4x_t sht4x, uint32_t *temp, uint32_t *humidity);
+
+#if CONFIG_SHT4X_FLOAT_API
+/** Temperature (°C). */
+static inline float sht4x_raw_to_temperature(uint32_t raw)
+{
+    return -45.0 + 175.0 * raw / 65535.0;
+}
+
+/** Relative humidity (%RH). */
+static inline float sht4x_raw_to_relative_humidity(uint32_t raw)
+{
+    float rh;
+
+    rh = -6.0 + 125.0 * raw / 65535.0;
+
+    // crop humidity to [0, 100]; see datasheet § 4.5
+    rh = (rh > 100.0f) ? 100.0f : rh;
+    rh = (rh < 0.0f) ? 0.0f : rh;
+
+    return rh;
+}
+#endif
+
+/**
+ * Scale raw value by `k / 0xffff`, rounded to nearest.
+ *
+ * The fractional part of `k / 0xffff` is a 0.32 fixed-point
+ * multiplier, which is exact (after rounding) for all raw values in
+ * [0, 0xffff] and k in {125000, 175000}. This needs a single 32x32 ->
+ * 64-bit multiplication and no division.
+ */
+static inline int32_t sht4x_scale_raw(uint32_t raw, uint32_t k)
+{
+    const uint32_t frac = ((uint64_t)(k % 65535) << 32) / 65535;
+
+    return (k / 65535) * raw + (uint32_t)(((uint64_t)raw * frac + (1u << 31)) >> 32);
+}
+
+/** Temperature (m°C). */
+static inline int32_t sht4x_raw_to_temperature_fixed(uint32_t raw)
+{
+    return -45000 + sht4x_scale_raw(raw, 175000);
+}
+
+/** Relative humidity (m%RH). */
+static inline int32_t sht4x_raw_to_relative_humidity_fixed(uint32_t raw)
+{
+    int32_t rh;
+
+    rh = -6000 + sht4x_scale_raw(raw, 125000);
+
+    // crop humidity to [0, 100000]; see datasheet § 4.5
+    rh = (rh > 100000) ? 100000 : rh;
+    rh = (rh < 0) ? 0 : rh;
+
+    return rh;
+}
@@ -0,0 +1,195 @@
+/**
+ * @file sht4x_sched.c
+ *
+ * Pipelined measurements of multiple SHT4x sensors.
+ */
+
+#include "sht4x_sched.h"
+#include "sht4x_priv.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "freertos/FreeRTOS.h"
+
+#include <stdbool.h>
+
+static const char *TAG = "sht4x_sched";
+
+/** Result of a sensor whose transfer is queued, but not yet finished. */
+#define QUEUED (-2)
+
+struct sht4x_sched {
+    size_t capacity;
+    size_t count;
+    sht4x_t sensors[];
+};
+
+esp_err_t sht4x_sched_create(size_t capacity, sht4x_sched_t *handle)
+{
+    struct sht4x_sched *sched;
+
+    if (!handle || !capacity) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    sched = malloc(sizeof(*sched) + capacity * sizeof(sched->sensors[0]));
+    if (!sched) {
+        *handle = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    sched->capacity = capacity;
+    sched->count = 0;
+
+    *handle = sched;
+    return ESP_OK;
+}
+
+esp_err_t sht4x_sched_add(sht4x_sched_t sched, sht4x_t sht4x)
+{
+    if (!sched || !sht4x) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (sched->count == sched->capacity) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    // a sweep holds each handle while its transfers are queued, and
+    // would wait for itself on a sensor added twice
+    for (size_t i = 0; i < sched->count; ++i) {
+        if (sched->sensors[i] == sht4x) {
+            return ESP_ERR_INVALID_STATE;
+        }
+    }
+
+    sched->sensors[sched->count++] = sht4x;
+    return ESP_OK;
+}
+
+size_t sht4x_sched_count(sht4x_sched_t sched)
+{
+    return sched ? sched->count : 0;
+}
+
+esp_err_t sht4x_sched_sweep(sht4x_sched_t sched, sht4x_sched_result_t *results)
+{
+    uint32_t num_retry = CONFIG_SHT4X_NUM_RETRY + 1;
+    size_t num_pending;
+    sht4x_async_t async;
+    esp_err_t ret;
+
+    if (!sched || !results) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    for (size_t i = 0; i < sched->count; ++i) {
+        results[i].err = ESP_ERR_NOT_FINISHED;
+    }
+
+    sht4x_async_init(&async);
+
+    do {
+        int64_t ready = 0, t;
+
+        // fire all measurement commands back-to-back
+        for (size_t i = 0; i < sched->count; ++i) {
+            if (results[i].err != ESP_ERR_NOT_FINISHED) {
+                continue;
+            }
+
+            ret = sht4x_start_measure_async(sched->sensors[i], SHT4X_HEAT_NONE, &async);
+            results[i].err = (ret == ESP_OK) ? QUEUED : ret;
+        }
+
+        sht4x_async_wait(&async);
+
+        for (size_t i = 0; i < sched->count; ++i) {
+            if (results[i].err != QUEUED) {
+                continue;
+            }
+
+            results[i].err = sht4x_start_measure_finish(sched->sensors[i], &t);
+            if (results[i].err == ESP_OK) {
+                results[i].err = ESP_ERR_NOT_FINISHED;
+                ready = (t > ready) ? t : ready;
+            }
+        }
+
+        sht4x_sleep_until(ready);
+
+        // collect results; sensors that are not ready yet (when polling)
+        // are read again, CRC failures are re-measured in the next round
+        do {
+            num_pending = 0;
+
+            for (size_t i = 0; i < sched->count; ++i) {
+                if (results[i].err != ESP_ERR_NOT_FINISHED) {
+                    continue;
+                }
+
+                ret = sht4x_fetch_measure_async(sched->sensors[i], &async);
+                results[i].err = (ret == ESP_OK) ? QUEUED : ret;
+            }
+
+            sht4x_async_wait(&async);
+
+            for (size_t i = 0; i < sched->count; ++i) {
+                if (results[i].err != QUEUED) {
+                    continue;
+                }
+
+                results[i].err = sht4x_fetch_measure_finish(sched->sensors[i],
+                                                            &results[i].temperature,
+                                                            &results[i].humidity);
+                num_pending += (results[i].err == ESP_ERR_NOT_FINISHED);
+            }
+
+#if CONFIG_SHT4X_WAIT_POLL
+            if (num_pending) {
+                sht4x_sleep_until(esp_timer_get_time() + CONFIG_SHT4X_POLL_INTERVAL_US);
+            }
+#endif
+        } while (num_pending);
+
+        for (size_t i = 0; i < sched->count; ++i) {
+            if (results[i].err == ESP_ERR_INVALID_CRC) {
+                results[i].err = ESP_ERR_NOT_FINISHED;
+                ++num_pending;
+            }
+        }
+
+        if (num_pending) {
+            ESP_LOGE(TAG, "... retrying to read from %u sensor(s)", (unsigned)num_pending);
+            vTaskDelay(CONFIG_SHT4X_RETRY_DELAY_MS / portTICK_PERIOD_MS);
+        }
+    } while (num_pending && --num_retry);
+
+    ret = ESP_OK;
+
+    for (size_t i = 0; i < sched->count; ++i) {
+        if (results[i].err == ESP_ERR_NOT_FINISHED) {
+            results[i].err = ESP_ERR_TIMEOUT;
+        }
+
+        if (ret == ESP_OK) {
+            ret = results[i].err;
+        }
+    }
+
+    return ret;
+}
+
+void sht4x_sched_delete(sht4x_sched_t sched)
+{
+    if (!sched) {
+        return;
+    }
+
+    for (size_t i = 0; i < sched->count; ++i) {
+        sht4x_delete(sched->sensors[i]);
+    }
+
+    free(sched);
+}
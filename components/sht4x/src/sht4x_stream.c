@@ -0,0 +1,379 @@
+/**
+ * @file sht4x_stream.c
+ *
+ * Background sampling of a SHT4x sensor into a ring buffer.
+ *
+ * The ring buffer has a single producer (the sampling task) and a
+ * single consumer (the reader), so it needs no lock: the producer only
+ * advances `head` and the consumer only advances `tail`. Both are
+ * indices into `samples`, which has one slot more than the capacity:
+ * a full buffer leaves one slot empty, so that `head == tail` only when
+ * the buffer is empty.
+ *
+ * Heater pulses are started with sht4x_start_measure(), so that the
+ * sensor handle is not held while the heater is active.
+ */
+
+#include "sht4x_stream.h"
+#include "sht4x_priv.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+static const char *TAG = "sht4x_stream";
+
+#if CONFIG_SHT4X_STREAM_TASK_CORE < 0
+#define STREAM_TASK_CORE tskNO_AFFINITY
+#else
+#define STREAM_TASK_CORE CONFIG_SHT4X_STREAM_TASK_CORE
+#endif
+
+struct sht4x_stream {
+    sht4x_t sht4x;
+    TickType_t period;
+    sht4x_heat_t heat;
+    TaskHandle_t task;
+    SemaphoreHandle_t done; // given by the task when it exits
+    StaticSemaphore_t done_buffer;
+    atomic_bool stop;
+    SemaphoreHandle_t lock; // protects heater and latest
+    StaticSemaphore_t lock_buffer;
+    sht4x_stream_heater_t heater;
+    bool reporting; // report changes only
+    sht4x_stream_report_t report;
+    bool has_latest;
+    sht4x_sample_t latest; // latest sample without heater activation or recovery
+    atomic_size_t head; // written by producer, in [0, capacity]
+    atomic_size_t tail; // written by consumer, in [0, capacity]
+    atomic_uint_fast32_t overflows;
+    atomic_uint_fast32_t errors;
+    atomic_size_t high_water;
+    atomic_uint_fast32_t heated;
+    atomic_uint_fast32_t recovering;
+    atomic_uint_fast32_t suppressed;
+    size_t capacity;
+    sht4x_sample_t samples[];
+};
+
+/** Index of the slot after `i` in the ring buffer. */
+static size_t ring_next(const struct sht4x_stream *stream, size_t i)
+{
+    return (i == stream->capacity) ? 0 : i + 1;
+}
+
+/** Number of samples between `tail` and `head`. */
+static size_t ring_count(const struct sht4x_stream *stream, size_t head, size_t tail)
+{
+    return (head >= tail) ? head - tail : head + stream->capacity + 1 - tail;
+}
+
+/** Append sample to ring buffer (producer). */
+static void push(struct sht4x_stream *stream, const sht4x_sample_t *sample)
+{
+    size_t head = atomic_load_explicit(&stream->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&stream->tail, memory_order_acquire);
+    size_t count = ring_count(stream, head, tail);
+
+    if (count == stream->capacity) {
+        atomic_fetch_add_explicit(&stream->overflows, 1, memory_order_relaxed);
+        return;
+    }
+
+    stream->samples[head] = *sample;
+    atomic_store_explicit(&stream->head, ring_next(stream, head), memory_order_release);
+
+    if (count + 1 > atomic_load_explicit(&stream->high_water, memory_order_relaxed)) {
+        atomic_store_explicit(&stream->high_water, count + 1, memory_order_relaxed);
+    }
+}
+
+/** Whether `sample` differs from `reported` by more than the deadband. */
+static bool changed(const sht4x_stream_report_t *report, const sht4x_sample_t *reported,
+                    const sht4x_sample_t *sample)
+{
+    return abs((int)sample->temperature - reported->temperature) > report->temperature_deadband ||
+           abs((int)sample->humidity - reported->humidity) > report->humidity_deadband;
+}
+
+/** Sampling period after a sample without change. */
+static TickType_t back_off(const struct sht4x_stream *stream, const sht4x_stream_report_t *report,
+                           TickType_t period)
+{
+    const TickType_t max_period = pdMS_TO_TICKS(report->max_period_ms);
+
+    period = (2 * period < max_period) ? 2 * period : max_period;
+    return (period > stream->period) ? period : stream->period;
+}
+
+/**
+ * Measure; heater pulses do not hold the sensor handle, so that other
+ * users of it get ESP_ERR_INVALID_STATE instead of waiting for the pulse.
+ */
+static esp_err_t measure(sht4x_t sht4x, sht4x_heat_t heat, uint32_t *temp, uint32_t *humidity)
+{
+    int64_t ready;
+    esp_err_t ret;
+
+    if (heat == SHT4X_HEAT_NONE) {
+        return sht4x_heat_measure_raw(sht4x, heat, temp, humidity);
+    }
+
+    ret = sht4x_start_measure(sht4x, heat, &ready);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    sht4x_sleep_until(ready);
+
+    while ((ret = sht4x_fetch_measure_raw(sht4x, temp, humidity)) == ESP_ERR_NOT_FINISHED) {
+        vTaskDelay(1);
+    }
+
+    return ret;
+}
+
+static void stream_task(void *arg)
+{
+    struct sht4x_stream *stream = arg;
+    TickType_t next = xTaskGetTickCount();
+    sht4x_stream_heater_t heater;
+    sht4x_stream_report_t report;
+    sht4x_sample_t sample, reported = {0};
+    bool reporting, has_reported = false;
+    TickType_t period = stream->period; // current sampling period
+    sht4x_heat_t heat;
+    bool pulse;
+    uint32_t periods = 0; // periods since last heater pulse
+    int64_t recovered = 0; // time (µs) when sensor has recovered from heater pulse
+    uint32_t t, rh;
+
+    while (!atomic_load(&stream->stop)) {
+        xSemaphoreTake(stream->lock, portMAX_DELAY);
+        heater = stream->heater;
+        reporting = stream->reporting;
+        report = stream->report;
+        xSemaphoreGive(stream->lock);
+
+        pulse = heater.interval && ++periods >= heater.interval;
+        heat = pulse ? heater.heat : stream->heat;
+        periods = pulse ? 0 : periods;
+
+        sample.timestamp = esp_timer_get_time();
+        sample.heated = (heat != SHT4X_HEAT_NONE);
+        sample.status = SHT4X_SAMPLE_OK; // failed samples are not pushed
+
+        if (measure(stream->sht4x, heat, &t, &rh) != ESP_OK) {
+            atomic_fetch_add_explicit(&stream->errors, 1, memory_order_relaxed);
+        } else if (!sample.heated && sample.timestamp < recovered) {
+            atomic_fetch_add_explicit(&stream->recovering, 1, memory_order_relaxed);
+        } else {
+            sample.temperature = t;
+            sample.humidity = rh;
+
+            if (sample.heated || !reporting) {
+                push(stream, &sample);
+                period = reporting ? period : stream->period;
+            } else if (!has_reported || changed(&report, &reported, &sample)) {
+                push(stream, &sample);
+                reported = sample;
+                has_reported = true;
+                period = stream->period; // sample fast while values change
+            } else if (report.heartbeat_ms && sample.timestamp - reported.timestamp >=
+                                                  1000 * (int64_t)report.heartbeat_ms) {
+                push(stream, &sample);
+                reported = sample;
+                period = back_off(stream, &report, period);
+            } else {
+                atomic_fetch_add_explicit(&stream->suppressed, 1, memory_order_relaxed);
+                period = back_off(stream, &report, period);
+            }
+
+            if (pulse) {
+                atomic_fetch_add_explicit(&stream->heated, 1, memory_order_relaxed);
+                recovered = esp_timer_get_time() + 1000 * (int64_t)heater.recovery_ms;
+            }
+
+            if (!sample.heated) {
+                xSemaphoreTake(stream->lock, portMAX_DELAY);
+                stream->latest = sample;
+                stream->has_latest = true;
+                xSemaphoreGive(stream->lock);
+            }
+        }
+
+        // sleep until next period, unless woken by sht4x_stream_stop()
+        next += period;
+        TickType_t now = xTaskGetTickCount();
+
+        if ((int32_t)(next - now) > 0) {
+            ulTaskNotifyTake(pdTRUE, next - now);
+        } else {
+            next = now; // measurement overran the period
+        }
+    }
+
+    xSemaphoreGive(stream->done);
+    vTaskDelete(NULL);
+}
+
+esp_err_t sht4x_stream_start(sht4x_t sht4x, uint32_t period_ms, sht4x_heat_t heat,
+                             size_t capacity, sht4x_stream_t *handle)
+{
+    struct sht4x_stream *stream;
+
+    if (!sht4x || !capacity || !handle) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    stream = malloc(sizeof(*stream) + (capacity + 1) * sizeof(stream->samples[0]));
+    if (!stream) {
+        *handle = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    stream->sht4x = sht4x;
+    stream->period = pdMS_TO_TICKS(period_ms);
+    stream->period = stream->period ? stream->period : 1;
+    stream->heat = heat;
+    stream->done = xSemaphoreCreateBinaryStatic(&stream->done_buffer);
+    stream->lock = xSemaphoreCreateMutexStatic(&stream->lock_buffer);
+    stream->heater = (sht4x_stream_heater_t){.heat = SHT4X_HEAT_NONE};
+    stream->reporting = false;
+    stream->has_latest = false;
+    stream->capacity = capacity;
+    atomic_init(&stream->stop, false);
+    atomic_init(&stream->head, 0);
+    atomic_init(&stream->tail, 0);
+    atomic_init(&stream->overflows, 0);
+    atomic_init(&stream->errors, 0);
+    atomic_init(&stream->high_water, 0);
+    atomic_init(&stream->heated, 0);
+    atomic_init(&stream->recovering, 0);
+    atomic_init(&stream->suppressed, 0);
+
+    if (xTaskCreatePinnedToCore(stream_task, "sht4x_stream",
+                                CONFIG_SHT4X_STREAM_TASK_STACK_SIZE, stream,
+                                CONFIG_SHT4X_STREAM_TASK_PRIORITY, &stream->task,
+                                STREAM_TASK_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "unable to create task");
+        vSemaphoreDelete(stream->done);
+        vSemaphoreDelete(stream->lock);
+        free(stream);
+        *handle = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    *handle = stream;
+    return ESP_OK;
+}
+
+esp_err_t sht4x_stream_set_heater(sht4x_stream_t stream, const sht4x_stream_heater_t *heater)
+{
+    if (!stream || !heater || (unsigned)heater->heat > SHT4X_HEAT_20_100) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(stream->lock, portMAX_DELAY);
+    stream->heater = *heater;
+    xSemaphoreGive(stream->lock);
+    return ESP_OK;
+}
+
+esp_err_t sht4x_stream_set_report(sht4x_stream_t stream, const sht4x_stream_report_t *report)
+{
+    if (!stream) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(stream->lock, portMAX_DELAY);
+    stream->reporting = (report != NULL);
+
+    if (report) {
+        stream->report = *report;
+    }
+
+    xSemaphoreGive(stream->lock);
+    return ESP_OK;
+}
+
+esp_err_t sht4x_stream_get_latest(sht4x_stream_t stream, sht4x_sample_t *sample)
+{
+    esp_err_t ret = ESP_ERR_NOT_FOUND;
+
+    if (!stream || !sample) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // the lock is only held to copy a sample, never during a measurement
+    xSemaphoreTake(stream->lock, portMAX_DELAY);
+
+    if (stream->has_latest) {
+        *sample = stream->latest;
+        ret = ESP_OK;
+    }
+
+    xSemaphoreGive(stream->lock);
+    return ret;
+}
+
+size_t sht4x_stream_read(sht4x_stream_t stream, sht4x_sample_t *samples,
+                         size_t max_samples)
+{
+    size_t tail, head, count;
+
+    if (!stream || !samples) {
+        return 0;
+    }
+
+    tail = atomic_load_explicit(&stream->tail, memory_order_relaxed);
+    head = atomic_load_explicit(&stream->head, memory_order_acquire);
+    count = ring_count(stream, head, tail);
+    count = (count < max_samples) ? count : max_samples;
+
+    for (size_t i = 0; i < count; ++i) {
+        samples[i] = stream->samples[tail];
+        tail = ring_next(stream, tail);
+    }
+
+    atomic_store_explicit(&stream->tail, tail, memory_order_release);
+    return count;
+}
+
+esp_err_t sht4x_stream_get_stats(sht4x_stream_t stream, sht4x_stream_stats_t *stats)
+{
+    if (!stream || !stats) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    stats->overflows = atomic_load_explicit(&stream->overflows, memory_order_relaxed);
+    stats->errors = atomic_load_explicit(&stream->errors, memory_order_relaxed);
+    stats->high_water = atomic_load_explicit(&stream->high_water, memory_order_relaxed);
+    stats->heated = atomic_load_explicit(&stream->heated, memory_order_relaxed);
+    stats->recovering = atomic_load_explicit(&stream->recovering, memory_order_relaxed);
+    stats->suppressed = atomic_load_explicit(&stream->suppressed, memory_order_relaxed);
+    return ESP_OK;
+}
+
+void sht4x_stream_stop(sht4x_stream_t stream)
+{
+    if (!stream) {
+        return;
+    }
+
+    atomic_store(&stream->stop, true);
+    xTaskNotifyGive(stream->task);
+
+    // not a notification of the calling task, which may have others pending
+    xSemaphoreTake(stream->done, portMAX_DELAY);
+    vSemaphoreDelete(stream->done);
+    vSemaphoreDelete(stream->lock);
+    free(stream);
+}
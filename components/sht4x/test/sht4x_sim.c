@@ -0,0 +1,231 @@
+/**
+ * @file sht4x_sim.c
+ *
+ * Simulated Sensirion SHT4x sensors for the linux target.
+ */
+
+#include "sht4x_sim.h"
+#include "sht4x_crc.h"
+
+#include "esp_timer.h"
+#include "driver/mock_i2c.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include <string.h>
+
+/** Command properties. */
+typedef struct {
+    uint8_t cmd;
+    uint32_t duration; // conversion time (us)
+    uint8_t heater; // heater power (mW)
+} sim_cmd_t;
+
+/** Maximum conversion times from the datasheet. */
+static const sim_cmd_t SIM_CMDS[] = {
+    {0xfd, 8300, 0}, // measure, high precision
+    {0xf6, 4500, 0}, // measure, medium precision
+    {0xe0, 1600, 0}, // measure, low precision
+    {0x39, 1008300, 200}, // heat 200 mW for 1 s, then measure
+    {0x32, 108300, 200}, // heat 200 mW for 0.1 s, then measure
+    {0x2f, 1008300, 110},
+    {0x24, 108300, 110},
+    {0x1e, 1008300, 20},
+    {0x15, 108300, 20},
+    {0x89, 1000, 0}, // read serial number
+    {0x94, 1000, 0}, // soft reset
+};
+
+typedef struct {
+    i2c_port_t port;
+    uint8_t address;
+    sht4x_sim_config_t config;
+    sht4x_sim_stats_t stats;
+    int64_t busy; // time when current command completes
+    uint8_t data[6]; // result of current command
+    bool has_data;
+} sim_sensor_t;
+
+static sim_sensor_t sensors[SHT4X_SIM_MAX_SENSORS];
+static size_t num_sensors;
+static uint32_t random_state;
+static SemaphoreHandle_t lock;
+static StaticSemaphore_t lock_buffer;
+
+/** Return true with probability p (xorshift32). */
+static bool chance(float p)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+
+    return (random_state >> 8) < p * (1 << 24);
+}
+
+static sim_sensor_t *find_sensor(i2c_port_t port, uint8_t address)
+{
+    for (size_t i = 0; i < num_sensors; ++i) {
+        if (sensors[i].port == port && sensors[i].address == address) {
+            return &sensors[i];
+        }
+    }
+
+    return NULL;
+}
+
+/** Store 16-bit word followed by its CRC. */
+static void put_word(uint8_t *data, uint16_t word)
+{
+    data[0] = word >> 8;
+    data[1] = word & 0xff;
+    data[2] = sht4x_crc8(data, 2);
+}
+
+/** Convert physical value to raw sensor value. */
+static uint16_t to_raw(float value, float offset, float scale)
+{
+    float raw = (value - offset) * 65535 / scale + 0.5f;
+
+    return raw < 0 ? 0 : raw > 65535 ? 65535 : raw;
+}
+
+static void start_command(sim_sensor_t *sensor, const sim_cmd_t *cmd)
+{
+    sensor->busy = esp_timer_get_time() + cmd->duration;
+    sensor->has_data = true;
+
+    switch (cmd->cmd) {
+    case 0x89:
+        put_word(&sensor->data[0], sensor->config.serial >> 16);
+        put_word(&sensor->data[3], sensor->config.serial & 0xffff);
+        break;
+    case 0x94:
+        sensor->has_data = false;
+        break;
+    default: {
+        // self-heating at the end of a heater pulse: 1 °C per 20 mW for 1 s
+        const float rise = cmd->heater / 20.0f * (cmd->duration > 500000 ? 1 : 0.25f);
+
+        put_word(&sensor->data[0], to_raw(sensor->config.temperature + rise, -45, 175));
+        put_word(&sensor->data[3], to_raw(sensor->config.humidity, -6, 125));
+        break;
+    }
+    }
+}
+
+static esp_err_t sim_write(i2c_port_t port, uint8_t address, const uint8_t *buffer,
+                           size_t len, TickType_t ticks_to_wait, int num_calls)
+{
+    esp_err_t err = ESP_FAIL;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    sim_sensor_t *sensor = find_sensor(port, address);
+
+    if (!sensor) {
+        // no device acknowledges the address
+    } else if (chance(sensor->config.bus_error_rate)) {
+        ++sensor->stats.bus_errors;
+        err = ESP_ERR_TIMEOUT;
+    } else if (esp_timer_get_time() < sensor->busy) {
+        ++sensor->stats.nacks;
+    } else if (len == 1) {
+        for (size_t i = 0; i < sizeof(SIM_CMDS) / sizeof(SIM_CMDS[0]); ++i) {
+            if (SIM_CMDS[i].cmd == buffer[0]) {
+                start_command(sensor, &SIM_CMDS[i]);
+                ++sensor->stats.commands;
+                err = ESP_OK;
+                break;
+            }
+        }
+    }
+
+    xSemaphoreGive(lock);
+    return err;
+}
+
+static esp_err_t sim_read(i2c_port_t port, uint8_t address, uint8_t *buffer, size_t len,
+                          TickType_t ticks_to_wait, int num_calls)
+{
+    esp_err_t err = ESP_FAIL;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    sim_sensor_t *sensor = find_sensor(port, address);
+
+    if (!sensor) {
+        // no device acknowledges the address
+    } else if (chance(sensor->config.bus_error_rate)) {
+        ++sensor->stats.bus_errors;
+        err = ESP_ERR_TIMEOUT;
+    } else if (esp_timer_get_time() < sensor->busy || !sensor->has_data) {
+        ++sensor->stats.nacks;
+    } else {
+        memcpy(buffer, sensor->data, len < 6 ? len : 6);
+
+        if (len > 2 && chance(sensor->config.crc_error_rate)) {
+            ++sensor->stats.crc_errors;
+            buffer[2] ^= 0x01;
+        }
+
+        sensor->has_data = false;
+        ++sensor->stats.reads;
+        err = ESP_OK;
+    }
+
+    xSemaphoreGive(lock);
+    return err;
+}
+
+void sht4x_sim_start(uint32_t seed)
+{
+    if (!lock) {
+        lock = xSemaphoreCreateMutexStatic(&lock_buffer);
+    }
+
+    num_sensors = 0;
+    random_state = seed ? seed : 1;
+
+    i2c_master_write_to_device_Stub(sim_write);
+    i2c_master_read_from_device_Stub(sim_read);
+}
+
+esp_err_t sht4x_sim_add(i2c_port_t port, uint8_t address, const sht4x_sim_config_t *config)
+{
+    esp_err_t err = ESP_OK;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+
+    if (find_sensor(port, address)) {
+        err = ESP_ERR_INVALID_STATE;
+    } else if (num_sensors == SHT4X_SIM_MAX_SENSORS) {
+        err = ESP_ERR_NO_MEM;
+    } else {
+        sensors[num_sensors++] = (sim_sensor_t){
+            .port = port, .address = address, .config = *config};
+    }
+
+    xSemaphoreGive(lock);
+    return err;
+}
+
+esp_err_t sht4x_sim_get_stats(i2c_port_t port, uint8_t address, sht4x_sim_stats_t *stats)
+{
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    const sim_sensor_t *sensor = find_sensor(port, address);
+
+    if (sensor) {
+        *stats = sensor->stats;
+        err = ESP_OK;
+    }
+
+    xSemaphoreGive(lock);
+    return err;
+}
+
+void sht4x_sim_stop(void)
+{
+    i2c_master_write_to_device_Stub(NULL);
+    i2c_master_read_from_device_Stub(NULL);
+}
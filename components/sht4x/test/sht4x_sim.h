@@ -0,0 +1,78 @@
+/**
+ * @file sht4x_sim.h
+ *
+ * Simulated Sensirion SHT4x sensors for the linux target.
+ *
+ * The simulator replaces i2c_master_write_to_device() and
+ * i2c_master_read_from_device() via their CMock stubs. Each simulated
+ * sensor is busy for the conversion time of the command it received;
+ * like the real sensor, it does not acknowledge (ESP_FAIL) reads or
+ * commands until the conversion is done.
+ */
+
+#pragma once
+
+#include "esp_err.h"
+#include "driver/i2c.h"
+
+#define SHT4X_SIM_MAX_SENSORS 8 /**< Maximum number of simulated sensors */
+
+/** Simulated sensor configuration. */
+typedef struct {
+    uint32_t serial; // serial number
+    float temperature; // temperature (°C) without heater
+    float humidity; // relative humidity (%)
+    float crc_error_rate; // probability of a corrupted CRC in read data
+    float bus_error_rate; // probability of a transfer failing with ESP_ERR_TIMEOUT
+} sht4x_sim_config_t;
+
+/** Simulated sensor statistics. */
+typedef struct {
+    uint32_t commands; // acknowledged commands
+    uint32_t reads; // acknowledged reads
+    uint32_t nacks; // transfers not acknowledged while busy
+    uint32_t crc_errors; // reads with injected CRC errors
+    uint32_t bus_errors; // transfers with injected bus errors
+} sht4x_sim_stats_t;
+
+/**
+ * Start simulator.
+ *
+ * Removes all simulated sensors and installs the I²C stubs. The mock
+ * of `driver/i2c.h` must be initialized.
+ *
+ * @param seed Seed of pseudo-random error injection
+ */
+void sht4x_sim_start(uint32_t seed);
+
+/**
+ * Add simulated sensor.
+ *
+ * @param port I²C port number
+ * @param address Device address
+ * @param config Sensor configuration
+ *
+ * @return ESP_OK on success, ESP_ERR_NO_MEM if there are already
+ * SHT4X_SIM_MAX_SENSORS sensors, ESP_ERR_INVALID_STATE if the address
+ * is in use.
+ */
+esp_err_t sht4x_sim_add(i2c_port_t port, uint8_t address, const sht4x_sim_config_t *config);
+
+/**
+ * Get statistics of simulated sensor.
+ *
+ * @param port I²C port number
+ * @param address Device address
+ * @param stats Statistics
+ *
+ * @return ESP_OK on success, ESP_ERR_NOT_FOUND if there is no sensor
+ * at the address.
+ */
+esp_err_t sht4x_sim_get_stats(i2c_port_t port, uint8_t address, sht4x_sim_stats_t *stats);
+
+/**
+ * Stop simulator.
+ *
+ * Removes the I²C stubs.
+ */
+void sht4x_sim_stop(void);
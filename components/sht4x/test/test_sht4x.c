@@ -5,17 +5,28 @@
  */
 
 #include "sht4x.h"
+#include "sht4x_convert.h"
+#include "sht4x_crc.h"
+#include "sht4x_filter.h"
+#include "sht4x_frame.h"
+#include "sht4x_humidity.h"
+#include "sht4x_sched.h"
+#include "sht4x_sim.h"
+#include "sht4x_stream.h"
+#include "esp_timer.h"
 #include "driver/stub_i2c.h"
 #include "driver/mock_i2c.h"
 
 #include "unity.h"
 
+#include <math.h>
 #include <string.h>
 
 static sht4x_t sht4x;
 
 #define SHT4X_CMD_SERIAL 0x89
 #define SHT4X_CMD_MEASURE 0xfd
+#define SHT4X_CMD_MEASURE_LOW 0xe0
 #define SHT4X_CMD_RESET 0x94
 
 #define SDA GPIO_NUM_6
@@ -38,6 +49,24 @@ static esp_err_t read_cb(i2c_port_t port, uint8_t address, uint8_t *buffer,
     return ESP_OK;
 }
 
+/** Initialize sensor at `address` with serial number 0xdeadbeef. */
+static void init_sensor(uint8_t address, sht4x_t *handle)
+{
+    const uint8_t cmd = SHT4X_CMD_SERIAL;
+    static const uint8_t serial_num[] = {0xde, 0xad, 0x98, 0xbe, 0xef, 0x92};
+
+    read_cb_data = serial_num;
+
+    i2c_master_write_to_device_ExpectAndReturn(PORT, address, &cmd, 1, portMAX_DELAY,
+                                               ESP_OK);
+    i2c_master_read_from_device_ExpectAndReturn(PORT, address, NULL, 6, portMAX_DELAY,
+                                                ESP_OK);
+    i2c_master_read_from_device_IgnoreArg_read_buffer();
+    i2c_master_read_from_device_AddCallback(read_cb);
+
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_init(PORT, address, handle));
+}
+
 static void setup()
 {
     const i2c_config_t config = {
@@ -50,20 +79,23 @@ static void setup()
     TEST_ASSERT_EQUAL(ESP_OK, i2c_param_config(PORT, &config));
     TEST_ASSERT_EQUAL(ESP_OK, i2c_driver_install(PORT, config.mode, 0, 0, 0));
 
-    const uint8_t cmd = SHT4X_CMD_SERIAL;
-    const uint8_t serial_num[] = {0xde, 0xad, 0x98, 0xbe, 0xef, 0x92};
+    mock_i2c_Init();
+    init_sensor(CONFIG_SHT4X_ADDRESS, &sht4x);
+}
 
-    read_cb_data = serial_num;
+/** Initialize simulated sensor at 20 °C and 40 % relative humidity. */
+static const sht4x_sim_config_t SIM_CONFIG = {
+    .serial = 0xdeadbeef,
+    .temperature = 20.0f,
+    .humidity = 40.0f,
+};
 
+static void sim_setup(const sht4x_sim_config_t *config)
+{
     mock_i2c_Init();
+    sht4x_sim_start(1);
 
-    i2c_master_write_to_device_ExpectAndReturn(PORT, CONFIG_SHT4X_ADDRESS, &cmd,
-                                               1, portMAX_DELAY, ESP_OK);
-    i2c_master_read_from_device_ExpectAndReturn(PORT, CONFIG_SHT4X_ADDRESS,
-                                                NULL, 6, portMAX_DELAY, ESP_OK);
-    i2c_master_read_from_device_IgnoreArg_read_buffer();
-    i2c_master_read_from_device_AddCallback(read_cb);
-
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_sim_add(PORT, CONFIG_SHT4X_ADDRESS, config));
     TEST_ASSERT_EQUAL(ESP_OK, sht4x_init(PORT, CONFIG_SHT4X_ADDRESS, &sht4x));
 }
 
@@ -77,6 +109,188 @@ static void teardown()
     sht4x = NULL;
 }
 
+TEST_CASE("sht4x_crc8() implementations should agree", "[sht4x]")
+{
+    const uint8_t data[] = {0xbe, 0xef};
+
+    TEST_ASSERT_EQUAL_HEX8(0x92, sht4x_crc8(data, 2));
+
+    for (int i = 0; i < 0x10000; ++i) {
+        const uint8_t word[] = {i >> 8, i & 0xff};
+        uint8_t expected = sht4x_crc8_bitwise(word, 2);
+
+        TEST_ASSERT_EQUAL_HEX8(expected, sht4x_crc8_nibble(word, 2));
+        TEST_ASSERT_EQUAL_HEX8(expected, sht4x_crc8_table(word, 2));
+    }
+}
+
+TEST_CASE("sht4x_convert_fixed() should convert and crop raw data", "[sht4x]")
+{
+    const uint16_t t_raw[] = {0x0000, 0x5f16, 0xffff};
+    const uint16_t rh_raw[] = {0x0c49, 0x5e35, 0xd916};
+    const int32_t t_expected[] = {-45000, 20001, 130000};
+    const int32_t rh_expected[] = {0, 40000, 100000};
+    int32_t t[3], rh[3];
+
+    sht4x_convert_fixed(t_raw, rh_raw, 3, t, rh);
+
+    for (int i = 0; i < 3; ++i) {
+        TEST_ASSERT_EQUAL_INT32(t_expected[i], t[i]);
+        TEST_ASSERT_EQUAL_INT32(rh_expected[i], rh[i]);
+    }
+
+#if CONFIG_SHT4X_FLOAT_API
+    float tf[3], rhf[3];
+
+    sht4x_convert(t_raw, rh_raw, 3, tf, rhf);
+
+    for (int i = 0; i < 3; ++i) {
+        TEST_ASSERT_FLOAT_WITHIN(1.0e-3, t_expected[i] / 1000.0, tf[i]);
+        TEST_ASSERT_FLOAT_WITHIN(1.0e-3, rh_expected[i] / 1000.0, rhf[i]);
+    }
+#endif
+}
+
+TEST_CASE("sht4x_derive_fixed() should match Magnus formula within error bounds", "[sht4x]")
+{
+    int32_t dew_point, absolute_humidity, vpd;
+
+    for (uint32_t t_raw = 1500; t_raw < 63500; t_raw += 997) {
+        for (uint32_t rh_raw = 3670; rh_raw < 55575; rh_raw += 1009) {
+            const double t = -45.0 + 175.0 * t_raw / 65535.0;
+            const double rh = -6.0 + 125.0 * rh_raw / 65535.0;
+            const double x = 17.62 * t / (243.12 + t);
+            const double es = 611.2 * exp(x); // Pa
+            const double g = log(rh / 100.0) + x;
+            const double dp = 243.12 * g / (17.62 - g);
+            const double ah = 2167.0 * rh / 100.0 * es / (273.15 + t); // mg/m³
+
+            sht4x_derive_fixed(&(uint16_t){t_raw}, &(uint16_t){rh_raw}, 1, &dew_point,
+                               &absolute_humidity, &vpd);
+
+            TEST_ASSERT_INT32_WITHIN(5, (int32_t)lround(1000.0 * dp), dew_point);
+            TEST_ASSERT_INT32_WITHIN(1 + (int32_t)(2.5e-4 * ah), (int32_t)lround(ah),
+                                     absolute_humidity);
+            TEST_ASSERT_INT32_WITHIN(1 + (int32_t)(1.5e-4 * es),
+                                     (int32_t)lround(es * (1.0 - rh / 100.0)), vpd);
+            TEST_ASSERT_EQUAL_INT32(dew_point, sht4x_dew_point_fixed(t_raw, rh_raw));
+
+#if CONFIG_SHT4X_FLOAT_API
+            const float tf = t, rhf = rh;
+
+            TEST_ASSERT_FLOAT_WITHIN(4.0e-4, dp, sht4x_dew_point(tf, rhf));
+            TEST_ASSERT_FLOAT_WITHIN(5.0e-9 * ah, ah / 1000.0, sht4x_absolute_humidity(tf, rhf));
+            TEST_ASSERT_FLOAT_WITHIN(1.0e-3, es * (1.0 - rh / 100.0) / 1000.0,
+                                     sht4x_vapor_pressure_deficit(tf, rhf));
+#endif
+        }
+    }
+
+    // 20 °C and 50 %RH
+    TEST_ASSERT_INT32_WITHIN(5, 9256, sht4x_dew_point_fixed(0x5f16, 0x72b0));
+}
+
+TEST_CASE("sht4x_frame_encode() should fall back to key frames", "[sht4x]")
+{
+    const uint8_t key[] = {0xa5, 0x00, 0x07, 0xe8, 0x03, 0x00, 0x00, 0x16, 0x5f, 0x35, 0x5e};
+    const uint8_t delta[] = {0xa5, 0x01, 0x07, 0x88, 0x13, 0x02, 0xfe};
+    sht4x_frame_encoder_t encoder;
+    uint8_t frame[SHT4X_FRAME_MAX_LEN];
+    sht4x_sample_t sample = {.timestamp = 1000000, .temperature = 0x5f16, .humidity = 0x5e35};
+
+    sht4x_frame_encoder_init(&encoder, 7, true);
+
+    TEST_ASSERT_EQUAL(SHT4X_FRAME_KEY_LEN, sht4x_frame_encode(&encoder, &sample, frame));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(key, frame, sizeof(key));
+    TEST_ASSERT_EQUAL_HEX8(sht4x_crc8(&key[1], sizeof(key) - 1), frame[sizeof(key)]);
+
+    sample.timestamp += 5000000;
+    sample.temperature += 2;
+    sample.humidity -= 2;
+
+    TEST_ASSERT_EQUAL(SHT4X_FRAME_DELTA_LEN, sht4x_frame_encode(&encoder, &sample, frame));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(delta, frame, sizeof(delta));
+    TEST_ASSERT_EQUAL_HEX8(sht4x_crc8(&delta[1], sizeof(delta) - 1), frame[sizeof(delta)]);
+
+    sample.temperature += 200; // too large for delta frame
+
+    TEST_ASSERT_EQUAL(SHT4X_FRAME_KEY_LEN, sht4x_frame_encode(&encoder, &sample, frame));
+}
+
+TEST_CASE("sht4x_filter_update() should average, smooth and reject outliers", "[sht4x]")
+{
+    const uint16_t values[] = {100, 104, 5000, 96, 100};
+    const uint16_t mean[] = {100, 102, 1735, 1733, 1732};
+    const uint16_t median[] = {100, 102, 104, 104, 100};
+    const uint16_t ewma[] = {100, 101, 1326, 1018, 789};
+    sht4x_filter_t filter;
+
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_filter_init(&filter, &(sht4x_filter_config_t){
+                                                             .type = SHT4X_FILTER_MEAN,
+                                                             .window = 3}));
+    for (int i = 0; i < 5; ++i) {
+        TEST_ASSERT_EQUAL(mean[i], sht4x_filter_update(&filter, values[i]));
+    }
+
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_filter_init(&filter, &(sht4x_filter_config_t){
+                                                             .type = SHT4X_FILTER_MEDIAN,
+                                                             .window = 3}));
+    for (int i = 0; i < 5; ++i) {
+        TEST_ASSERT_EQUAL(median[i], sht4x_filter_update(&filter, values[i]));
+    }
+
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_filter_init(&filter, &(sht4x_filter_config_t){
+                                                             .type = SHT4X_FILTER_EWMA,
+                                                             .shift = 2}));
+    for (int i = 0; i < 5; ++i) {
+        TEST_ASSERT_EQUAL(ewma[i], sht4x_filter_update(&filter, values[i]));
+    }
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG,
+                      sht4x_filter_init(&filter, &(sht4x_filter_config_t){
+                                                     .type = SHT4X_FILTER_MEDIAN,
+                                                     .window = SHT4X_FILTER_MAX_WINDOW + 1}));
+}
+
+TEST_CASE("sht4x_init_from_state() should reject corrupt filter state", "[sht4x]")
+{
+    const uint16_t values[] = {100, 104, 5000, 96, 100};
+    const uint16_t median[] = {100, 102, 104, 104, 100};
+    sht4x_state_t state = {.magic = SHT4X_STATE_MAGIC, .oversampling = 1};
+    sht4x_filter_t filter;
+    sht4x_t handle;
+
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_filter_init(&state.filter[0], &(sht4x_filter_config_t){
+                                                                      .type = SHT4X_FILTER_MEDIAN,
+                                                                      .window = 3}));
+    for (int i = 0; i < 3; ++i) {
+        sht4x_filter_update(&state.filter[0], values[i]);
+    }
+
+    // the sorted window is rebuilt from the saved one
+    memset(state.filter[0].sorted, 0xff, sizeof(state.filter[0].sorted));
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_filter_restore(&filter, &state.filter[0]));
+
+    for (int i = 3; i < 5; ++i) {
+        TEST_ASSERT_EQUAL(median[i], sht4x_filter_update(&filter, values[i]));
+    }
+
+    state.filter[0].next = 3;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, sht4x_init_from_state(&state, false, &handle));
+    TEST_ASSERT_NULL(handle);
+
+    state.filter[0].next = 0;
+    state.filter[0].window = SHT4X_FILTER_MAX_WINDOW + 1;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, sht4x_init_from_state(&state, false, &handle));
+
+    state.filter[0].window = 3;
+    state.filter[1].type = (sht4x_filter_type_t)0x5a;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, sht4x_init_from_state(&state, false, &handle));
+
+    state.filter[1] = (sht4x_filter_t){.type = SHT4X_FILTER_EWMA, .shift = 9};
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, sht4x_init_from_state(&state, false, &handle));
+}
+
 TEST_CASE("sht4x_init() should return handle", "[sht4x]")
 {
     setup();
@@ -156,6 +370,7 @@ TEST_CASE("sht4x_heat_measure_raw() should timeout if unable to read data from s
     teardown();
 }
 
+#if CONFIG_SHT4X_FLOAT_API
 TEST_CASE("sht4x_heat_measure() should return temperature and humidity", "[sht4x]")
 {
     uint8_t cmd = SHT4X_CMD_MEASURE;
@@ -179,7 +394,9 @@ TEST_CASE("sht4x_heat_measure() should return temperature and humidity", "[sht4x
     TEST_ASSERT_FLOAT_WITHIN(DELTA, rh_expected, rh);
     teardown();
 }
+#endif
 
+#if CONFIG_SHT4X_FLOAT_API
 TEST_CASE("sht4x_heat_measure() should not return a relative humidity above 100", "[sht4x]")
 {
     uint8_t cmd = SHT4X_CMD_MEASURE;
@@ -202,7 +419,9 @@ TEST_CASE("sht4x_heat_measure() should not return a relative humidity above 100"
     TEST_ASSERT_FLOAT_WITHIN(DELTA, expected, rh);
     teardown();
 }
+#endif
 
+#if CONFIG_SHT4X_FLOAT_API
 TEST_CASE("sht4x_heat_measure() should not return a relative humidity below 0", "[sht4x]")
 {
     uint8_t cmd = SHT4X_CMD_MEASURE;
@@ -225,6 +444,81 @@ TEST_CASE("sht4x_heat_measure() should not return a relative humidity below 0",
     TEST_ASSERT_FLOAT_WITHIN(DELTA, expected, rh);
     teardown();
 }
+#endif
+
+TEST_CASE("sht4x_set_precision() should select measurement command", "[sht4x]")
+{
+    uint8_t cmd = SHT4X_CMD_MEASURE_LOW;
+    const uint8_t data[] = {0x5f, 0x16, 0x1a, 0x5e, 0x35, 0x3b};
+    uint32_t temp, rh;
+
+    setup();
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, sht4x_set_precision(sht4x, 3));
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_set_precision(sht4x, SHT4X_PRECISION_LOW));
+
+    read_cb_data = data;
+    i2c_master_write_to_device_ExpectAndReturn(PORT, CONFIG_SHT4X_ADDRESS, &cmd,
+                                               1, portMAX_DELAY, ESP_OK);
+    i2c_master_read_from_device_ExpectAndReturn(PORT, CONFIG_SHT4X_ADDRESS,
+                                                NULL, 6, portMAX_DELAY, ESP_OK);
+    i2c_master_read_from_device_IgnoreArg_read_buffer();
+    i2c_master_read_from_device_AddCallback(read_cb);
+
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_measure_raw(sht4x, &temp, &rh));
+    TEST_ASSERT_EQUAL_HEX32(0x5f16, temp);
+    TEST_ASSERT_EQUAL_HEX32(0x5e35, rh);
+    teardown();
+}
+
+TEST_CASE("sht4x_measure_fixed() should return temperature and humidity", "[sht4x]")
+{
+    uint8_t cmd = SHT4X_CMD_MEASURE;
+    const uint8_t data[] = {0x5f, 0x16, 0x1a, 0x5e, 0x35, 0x3b};
+    int32_t temp, rh;
+
+    setup();
+
+    read_cb_data = data;
+    i2c_master_write_to_device_ExpectAndReturn(PORT, CONFIG_SHT4X_ADDRESS, &cmd,
+                                               1, portMAX_DELAY, ESP_OK);
+    i2c_master_read_from_device_ExpectAndReturn(PORT, CONFIG_SHT4X_ADDRESS,
+                                                NULL, 6, portMAX_DELAY, ESP_OK);
+    i2c_master_read_from_device_IgnoreArg_read_buffer();
+    i2c_master_read_from_device_AddCallback(read_cb);
+
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_measure_fixed(sht4x, &temp, &rh));
+    TEST_ASSERT_EQUAL_INT32(20001, temp);
+    TEST_ASSERT_EQUAL_INT32(40000, rh);
+    teardown();
+}
+
+TEST_CASE("sht4x_measure_fixed() should crop relative humidity to [0, 100000]", "[sht4x]")
+{
+    uint8_t cmd = SHT4X_CMD_MEASURE;
+    const uint8_t above[] = {0x5f, 0x16, 0x1a, 0xd9, 0x16, 0x63}; // 100.000610 %
+    const uint8_t below[] = {0x5f, 0x16, 0x1a, 0x0c, 0x49, 0x80}; // -0.001297 %
+    const uint8_t *data[] = {above, below};
+    const int32_t expected[] = {100000, 0};
+    int32_t temp, rh;
+
+    setup();
+    i2c_master_read_from_device_AddCallback(read_cb);
+
+    for (int i = 0; i < 2; ++i) {
+        read_cb_data = data[i];
+        i2c_master_write_to_device_ExpectAndReturn(PORT, CONFIG_SHT4X_ADDRESS, &cmd,
+                                                   1, portMAX_DELAY, ESP_OK);
+        i2c_master_read_from_device_ExpectAndReturn(PORT, CONFIG_SHT4X_ADDRESS,
+                                                    NULL, 6, portMAX_DELAY, ESP_OK);
+        i2c_master_read_from_device_IgnoreArg_read_buffer();
+
+        TEST_ASSERT_EQUAL(ESP_OK, sht4x_measure_fixed(sht4x, &temp, &rh));
+        TEST_ASSERT_EQUAL_INT32(expected[i], rh);
+    }
+
+    teardown();
+}
 
 TEST_CASE("sht4x_measure_raw() should handle invalid sensor object", "[sht4x]")
 {
@@ -257,6 +551,103 @@ TEST_CASE("sht4x_measure_raw() should return temperature and humidity", "[sht4x]
     teardown();
 }
 
+TEST_CASE("sht4x_measure_raw() should wait for the conversion time", "[sht4x]")
+{
+    uint8_t cmd = SHT4X_CMD_MEASURE;
+    const uint8_t data[] = {0x5f, 0x16, 0x1a, 0x5e, 0x35, 0x3b};
+    uint32_t temp, rh;
+    int64_t start;
+
+    setup();
+
+    read_cb_data = data;
+    i2c_master_write_to_device_ExpectAndReturn(PORT, CONFIG_SHT4X_ADDRESS, &cmd,
+                                               1, portMAX_DELAY, ESP_OK);
+    i2c_master_read_from_device_ExpectAndReturn(PORT, CONFIG_SHT4X_ADDRESS,
+                                                NULL, 6, portMAX_DELAY, ESP_OK);
+    i2c_master_read_from_device_IgnoreArg_read_buffer();
+    i2c_master_read_from_device_AddCallback(read_cb);
+
+    start = esp_timer_get_time();
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_measure_raw(sht4x, &temp, &rh));
+    TEST_ASSERT_GREATER_OR_EQUAL(10000, esp_timer_get_time() - start);
+    teardown();
+}
+
+/** Measure from another task and notify `arg` when done. */
+static void measure_task(void *arg)
+{
+    uint32_t temp, rh;
+
+    if (sht4x_measure_raw(sht4x, &temp, &rh) == ESP_OK && temp == 0x5f16) {
+        xTaskNotifyGive((TaskHandle_t)arg);
+    }
+
+    vTaskDelete(NULL);
+}
+
+TEST_CASE("sht4x_measure_raw() should serialize concurrent users of a handle", "[sht4x]")
+{
+    uint8_t cmd = SHT4X_CMD_MEASURE;
+    const uint8_t data[] = {0x5f, 0x16, 0x1a, 0x5e, 0x35, 0x3b};
+    uint32_t temp, rh;
+
+    setup();
+
+    read_cb_data = data;
+    i2c_master_read_from_device_AddCallback(read_cb);
+
+    for (int i = 0; i < 2; ++i) {
+        i2c_master_write_to_device_ExpectAndReturn(PORT, CONFIG_SHT4X_ADDRESS, &cmd,
+                                                   1, portMAX_DELAY, ESP_OK);
+        i2c_master_read_from_device_ExpectAndReturn(PORT, CONFIG_SHT4X_ADDRESS,
+                                                    NULL, 6, portMAX_DELAY, ESP_OK);
+        i2c_master_read_from_device_IgnoreArg_read_buffer();
+    }
+
+    TEST_ASSERT_EQUAL(pdPASS, xTaskCreate(measure_task, "measure", 4096,
+                                          xTaskGetCurrentTaskHandle(), 5, NULL));
+
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_measure_raw(sht4x, &temp, &rh));
+    TEST_ASSERT_EQUAL(1, ulTaskNotifyTake(pdTRUE, 100));
+    TEST_ASSERT_EQUAL_HEX32(0x5f16, temp);
+    teardown();
+}
+
+TEST_CASE("sht4x_get_latest() should measure only if cached sample is too old", "[sht4x]")
+{
+    uint8_t cmd = SHT4X_CMD_MEASURE;
+    const uint8_t data[] = {0x5f, 0x16, 0x1a, 0x5e, 0x35, 0x3b};
+    sht4x_sample_t first, second;
+
+    setup();
+
+    read_cb_data = data;
+    i2c_master_read_from_device_AddCallback(read_cb);
+
+    for (int i = 0; i < 2; ++i) {
+        i2c_master_write_to_device_ExpectAndReturn(PORT, CONFIG_SHT4X_ADDRESS, &cmd,
+                                                   1, portMAX_DELAY, ESP_OK);
+        i2c_master_read_from_device_ExpectAndReturn(PORT, CONFIG_SHT4X_ADDRESS,
+                                                    NULL, 6, portMAX_DELAY, ESP_OK);
+        i2c_master_read_from_device_IgnoreArg_read_buffer();
+    }
+
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_get_latest(sht4x, 1000000, &first));
+    TEST_ASSERT_EQUAL_HEX16(0x5f16, first.temperature);
+    TEST_ASSERT_EQUAL_HEX16(0x5e35, first.humidity);
+
+    // cached
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_get_latest(sht4x, 1000000, &second));
+    TEST_ASSERT_EQUAL(first.timestamp, second.timestamp);
+
+    // too old
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_get_latest(sht4x, 0, &second));
+    TEST_ASSERT_GREATER_THAN(first.timestamp, second.timestamp);
+    teardown();
+}
+
+#if CONFIG_SHT4X_FLOAT_API
 TEST_CASE("sht4x_measure() should handle invalid sensor object", "[sht4x]")
 {
     float temp, rh;
@@ -287,6 +678,707 @@ TEST_CASE("sht4x_measure() should return temperature and humidity", "[sht4x]")
     TEST_ASSERT_FLOAT_WITHIN(DELTA, rh_expected, rh);
     teardown();
 }
+#endif
+
+TEST_CASE("sht4x_fetch_measure_raw() should not return data before it is ready", "[sht4x]")
+{
+    uint8_t cmd = SHT4X_CMD_MEASURE;
+    uint32_t temp, rh;
+    int64_t ready;
+
+    setup();
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, sht4x_fetch_measure_raw(sht4x, &temp, &rh));
+
+    i2c_master_write_to_device_ExpectAndReturn(PORT, CONFIG_SHT4X_ADDRESS, &cmd,
+                                               1, portMAX_DELAY, ESP_OK);
+
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_start_measure(sht4x, SHT4X_HEAT_NONE, &ready));
+    TEST_ASSERT(ready > esp_timer_get_time());
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FINISHED, sht4x_fetch_measure_raw(sht4x, &temp, &rh));
+    teardown();
+}
+
+TEST_CASE("sht4x_fetch_measure_raw() should return temperature and humidity", "[sht4x]")
+{
+    uint8_t cmd = SHT4X_CMD_MEASURE;
+    const uint8_t data[] = {0x5f, 0x16, 0x1a, 0x5e, 0x35, 0x3b};
+    uint32_t temp_expected = 0x5f16;
+    uint32_t rh_expected = 0x5e35;
+    uint32_t temp, rh;
+    int64_t ready;
+
+    setup();
+
+    read_cb_data = data;
+    i2c_master_write_to_device_ExpectAndReturn(PORT, CONFIG_SHT4X_ADDRESS, &cmd,
+                                               1, portMAX_DELAY, ESP_OK);
+    i2c_master_read_from_device_ExpectAndReturn(PORT, CONFIG_SHT4X_ADDRESS,
+                                                NULL, 6, portMAX_DELAY, ESP_OK);
+    i2c_master_read_from_device_IgnoreArg_read_buffer();
+    i2c_master_read_from_device_AddCallback(read_cb);
+
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_start_measure(sht4x, SHT4X_HEAT_NONE, &ready));
+
+    while (esp_timer_get_time() < ready) {
+        vTaskDelay(1);
+    }
+
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_fetch_measure_raw(sht4x, &temp, &rh));
+    TEST_ASSERT_EQUAL_HEX32(temp_expected, temp);
+    TEST_ASSERT_EQUAL_HEX32(rh_expected, rh);
+    teardown();
+}
+
+TEST_CASE("sht4x_sched_sweep() should send all commands before reading results", "[sht4x]")
+{
+    uint8_t cmd = SHT4X_CMD_MEASURE;
+    const uint8_t data[] = {0x5f, 0x16, 0x1a, 0x5e, 0x35, 0x3b};
+    const uint8_t addresses[] = {0x44, 0x45, 0x46};
+    sht4x_sched_result_t results[3];
+    sht4x_sched_t sched;
+    sht4x_t handle;
+
+    mock_i2c_Init();
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_sched_create(3, &sched));
+
+    for (int i = 0; i < 3; ++i) {
+        init_sensor(addresses[i], &handle);
+        TEST_ASSERT_EQUAL(ESP_OK, sht4x_sched_add(sched, handle));
+    }
+
+    TEST_ASSERT_EQUAL(3, sht4x_sched_count(sched));
+    TEST_ASSERT_EQUAL(ESP_ERR_NO_MEM, sht4x_sched_add(sched, handle));
+
+    read_cb_data = data;
+
+    for (int i = 0; i < 3; ++i) {
+        i2c_master_write_to_device_ExpectAndReturn(PORT, addresses[i], &cmd, 1,
+                                                   portMAX_DELAY, ESP_OK);
+    }
+
+    for (int i = 0; i < 3; ++i) {
+        i2c_master_read_from_device_ExpectAndReturn(PORT, addresses[i], NULL, 6,
+                                                    portMAX_DELAY, ESP_OK);
+        i2c_master_read_from_device_IgnoreArg_read_buffer();
+    }
+
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_sched_sweep(sched, results));
+
+    for (int i = 0; i < 3; ++i) {
+        TEST_ASSERT_EQUAL(ESP_OK, results[i].err);
+        TEST_ASSERT_EQUAL_HEX32(0x5f16, results[i].temperature);
+        TEST_ASSERT_EQUAL_HEX32(0x5e35, results[i].humidity);
+    }
+
+    mock_i2c_Verify();
+    mock_i2c_Destroy();
+    stub_i2c_reset();
+    sht4x_sched_delete(sched);
+}
+
+TEST_CASE("sht4x_stream_read() should return timestamped samples", "[sht4x]")
+{
+    uint8_t cmd = SHT4X_CMD_MEASURE;
+    const uint8_t data[] = {0x5f, 0x16, 0x1a, 0x5e, 0x35, 0x3b};
+    sht4x_stream_stats_t stats;
+    sht4x_stream_t stream;
+    sht4x_sample_t sample;
+    int64_t start;
+    size_t n = 0;
+
+    setup();
+
+    read_cb_data = data;
+    i2c_master_write_to_device_ExpectAndReturn(PORT, CONFIG_SHT4X_ADDRESS, &cmd,
+                                               1, portMAX_DELAY, ESP_OK);
+    i2c_master_read_from_device_ExpectAndReturn(PORT, CONFIG_SHT4X_ADDRESS,
+                                                NULL, 6, portMAX_DELAY, ESP_OK);
+    i2c_master_read_from_device_IgnoreArg_read_buffer();
+    i2c_master_read_from_device_AddCallback(read_cb);
+
+    // first sample is taken immediately; the next one after 10 s
+    start = esp_timer_get_time();
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_stream_start(sht4x, 10000, SHT4X_HEAT_NONE, 4,
+                                                 &stream));
+
+    for (int i = 0; i < 100 && !n; ++i) {
+        vTaskDelay(1);
+        n = sht4x_stream_read(stream, &sample, 1);
+    }
+
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_stream_get_stats(stream, &stats));
+    sht4x_stream_stop(stream);
+
+    TEST_ASSERT_EQUAL(1, n);
+    TEST_ASSERT_GREATER_OR_EQUAL(start, sample.timestamp);
+    TEST_ASSERT_EQUAL_HEX16(0x5f16, sample.temperature);
+    TEST_ASSERT_EQUAL_HEX16(0x5e35, sample.humidity);
+    TEST_ASSERT_EQUAL(0, stats.overflows);
+    TEST_ASSERT_EQUAL(0, stats.errors);
+    TEST_ASSERT_EQUAL(1, stats.high_water);
+    teardown();
+}
+
+TEST_CASE("sht4x_stream_read() should keep simulated samples in order across wraparound", "[sht4x]")
+{
+    sht4x_stream_stats_t stats;
+    sht4x_stream_t stream;
+    sht4x_sample_t samples[2];
+    int64_t last = 0;
+    size_t total = 0, n;
+
+    sim_setup(&SIM_CONFIG);
+
+    // capacity 3 (not a power of 2) wraps every few samples
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_stream_start(sht4x, 20, SHT4X_HEAT_NONE, 3, &stream));
+
+    for (int i = 0; i < 30; ++i) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+        n = sht4x_stream_read(stream, samples, 2);
+
+        for (size_t k = 0; k < n; ++k) {
+            TEST_ASSERT_GREATER_THAN(last, samples[k].timestamp);
+            TEST_ASSERT_EQUAL_HEX16(0x5f16, samples[k].temperature);
+            last = samples[k].timestamp;
+        }
+
+        total += n;
+    }
+
+    // let the ring fill up and overflow
+    vTaskDelay(pdMS_TO_TICKS(200));
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_stream_get_stats(stream, &stats));
+    TEST_ASSERT_EQUAL(2, sht4x_stream_read(stream, samples, 2));
+    TEST_ASSERT_EQUAL(1, sht4x_stream_read(stream, samples, 2));
+
+    // an unrelated notification must not end the wait for the task
+    xTaskNotifyGive(xTaskGetCurrentTaskHandle());
+    sht4x_stream_stop(stream);
+    TEST_ASSERT_EQUAL(1, ulTaskNotifyTake(pdTRUE, 0));
+
+    TEST_ASSERT_GREATER_OR_EQUAL(6, total);
+    TEST_ASSERT_EQUAL(3, stats.high_water);
+    TEST_ASSERT_GREATER_OR_EQUAL(1, stats.overflows);
+    teardown();
+}
+
+TEST_CASE("sht4x_stream_set_heater() should mark heater pulses and hide recovery", "[sht4x]")
+{
+    const sht4x_stream_heater_t heater = {
+        .heat = SHT4X_HEAT_20_100, .interval = 4, .recovery_ms = 30};
+    sht4x_stream_stats_t stats;
+    sht4x_stream_t stream;
+    sht4x_sample_t samples[32], latest;
+    size_t n;
+    uint32_t heated = 0, busy = 0, t, rh;
+    esp_err_t ret;
+
+    sim_setup(&SIM_CONFIG);
+
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_stream_start(sht4x, 50, SHT4X_HEAT_NONE, 32, &stream));
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_stream_set_heater(stream, &heater));
+
+    // measure alongside the stream: pulses turn us away instead of
+    // losing their result
+    for (int i = 0; i < 40; ++i) {
+        ret = sht4x_measure_raw(sht4x, &t, &rh);
+        TEST_ASSERT(ret == ESP_OK || ret == ESP_ERR_INVALID_STATE);
+        busy += (ret == ESP_ERR_INVALID_STATE);
+        vTaskDelay(pdMS_TO_TICKS(20));
+    }
+
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_stream_get_latest(stream, &latest));
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_stream_get_stats(stream, &stats));
+    n = sht4x_stream_read(stream, samples, 32);
+    sht4x_stream_stop(stream);
+
+    for (size_t i = 0; i < n; ++i) {
+        if (!samples[i].heated) {
+            TEST_ASSERT_EQUAL_HEX16(0x5f16, samples[i].temperature);
+            continue;
+        }
+
+        ++heated;
+
+        // the sample after a pulse is taken once the sensor has recovered
+        if (i + 1 < n) {
+            TEST_ASSERT_FALSE(samples[i + 1].heated);
+            TEST_ASSERT_GREATER_OR_EQUAL(108300 + 30000,
+                                         samples[i + 1].timestamp - samples[i].timestamp);
+        }
+    }
+
+    TEST_ASSERT_GREATER_OR_EQUAL(1, heated);
+    TEST_ASSERT_GREATER_OR_EQUAL(1, busy);
+    TEST_ASSERT_EQUAL(heated, stats.heated);
+    TEST_ASSERT_GREATER_OR_EQUAL(1, stats.recovering);
+#if !CONFIG_SHT4X_WAIT_TICK
+    // sleeping whole ticks may read the sensor before it is ready
+    TEST_ASSERT_EQUAL(0, stats.errors);
+#endif
+    TEST_ASSERT_FALSE(latest.heated);
+    TEST_ASSERT_EQUAL_HEX16(0x5f16, latest.temperature);
+    teardown();
+}
+
+TEST_CASE("sht4x_stream_set_report() should suppress unchanged samples and back off", "[sht4x]")
+{
+    const sht4x_stream_report_t report = {.temperature_deadband = 10,
+                                          .humidity_deadband = 10,
+                                          .heartbeat_ms = 200,
+                                          .max_period_ms = 80};
+    sht4x_stream_stats_t stats;
+    sht4x_sim_stats_t sim_stats;
+    sht4x_stream_t stream;
+    sht4x_sample_t samples[16];
+    size_t n;
+
+    sim_setup(&SIM_CONFIG);
+
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_stream_start(sht4x, 10, SHT4X_HEAT_NONE, 16, &stream));
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_stream_set_report(stream, &report));
+    vTaskDelay(pdMS_TO_TICKS(500));
+
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_stream_get_stats(stream, &stats));
+    n = sht4x_stream_read(stream, samples, 16);
+    sht4x_stream_stop(stream);
+
+    // first sample and heartbeats only, sampled ever more slowly
+    TEST_ASSERT_GREATER_OR_EQUAL(2, n);
+    TEST_ASSERT_LESS_OR_EQUAL(4, n);
+    TEST_ASSERT_GREATER_OR_EQUAL(200000, samples[1].timestamp - samples[0].timestamp);
+    TEST_ASSERT_GREATER_OR_EQUAL(4, stats.suppressed);
+
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_sim_get_stats(PORT, CONFIG_SHT4X_ADDRESS, &sim_stats));
+    TEST_ASSERT_LESS_THAN(1 + 15, sim_stats.commands);
+    teardown();
+}
+
+TEST_CASE("sht4x_start_measure() should not restart a pending simulated measurement", "[sht4x]")
+{
+    sht4x_sim_stats_t stats;
+    sht4x_sample_t sample;
+    uint32_t temp, rh;
+    int64_t ready;
+
+    sim_setup(&SIM_CONFIG);
+
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_start_measure(sht4x, SHT4X_HEAT_NONE, &ready));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE,
+                      sht4x_start_measure(sht4x, SHT4X_HEAT_NONE, &ready));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, sht4x_measure_raw(sht4x, &temp, &rh));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, sht4x_read_burst(sht4x, &sample, 1, 0));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, sht4x_reset(sht4x));
+
+    // polling may find the sensor still busy at `ready`
+    while (sht4x_fetch_measure_raw(sht4x, &temp, &rh) == ESP_ERR_NOT_FINISHED) {
+        vTaskDelay(1);
+    }
+
+    TEST_ASSERT_EQUAL_HEX32(0x5f16, temp);
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_measure_raw(sht4x, &temp, &rh));
+
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_sim_get_stats(PORT, CONFIG_SHT4X_ADDRESS, &stats));
+    TEST_ASSERT_EQUAL(1 + 2, stats.commands);
+    teardown();
+}
+
+TEST_CASE("sht4x_measure_raw() should measure simulated sensor", "[sht4x]")
+{
+    sht4x_sim_stats_t stats;
+    uint32_t serial, temp, rh;
+    int64_t start;
+
+    sim_setup(&SIM_CONFIG);
+
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_get_serial(sht4x, &serial));
+    TEST_ASSERT_EQUAL_HEX32(0xdeadbeef, serial);
+
+    start = esp_timer_get_time();
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_measure_raw(sht4x, &temp, &rh));
+    TEST_ASSERT_GREATER_OR_EQUAL(8300, esp_timer_get_time() - start);
+    TEST_ASSERT_EQUAL_HEX32(0x5f16, temp);
+    TEST_ASSERT_EQUAL_HEX32(0x5e35, rh);
+
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_sim_get_stats(PORT, CONFIG_SHT4X_ADDRESS, &stats));
+    TEST_ASSERT_EQUAL(2, stats.commands);
+    TEST_ASSERT_EQUAL(2, stats.reads);
+    teardown();
+}
+
+TEST_CASE("sht4x_init_from_state() should skip serial number of simulated sensor", "[sht4x]")
+{
+    sht4x_sim_stats_t stats;
+    sht4x_state_t state = {0};
+    uint32_t serial, temp, rh;
+    sht4x_t handle;
+    int64_t start;
+
+    sim_setup(&SIM_CONFIG);
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, sht4x_init_from_state(&state, false, &handle));
+    TEST_ASSERT_NULL(handle);
+
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_set_precision(sht4x, SHT4X_PRECISION_LOW));
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_save_state(sht4x, &state));
+    sht4x_delete(sht4x);
+
+    // warm start: one command per measurement
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_init_from_state(&state, false, &sht4x));
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_get_serial(sht4x, &serial));
+    TEST_ASSERT_EQUAL_HEX32(0xdeadbeef, serial);
+
+    start = esp_timer_get_time();
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_measure_raw(sht4x, &temp, &rh));
+#if !CONFIG_SHT4X_WAIT_TICK
+    // sleeping whole ticks rounds the conversion up to a tick
+    TEST_ASSERT_LESS_THAN(10000, esp_timer_get_time() - start);
+#endif
+    TEST_ASSERT_EQUAL_HEX32(0x5f16, temp);
+
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_sim_get_stats(PORT, CONFIG_SHT4X_ADDRESS, &stats));
+    TEST_ASSERT_EQUAL(1 + 1, stats.commands);
+    sht4x_delete(sht4x);
+
+    // verify lazily, and detect a replaced sensor once
+    state.serial = 0x12345678;
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_init_from_state(&state, true, &sht4x));
+    TEST_ASSERT_EQUAL(SHT4X_ERR_SERIAL, sht4x_measure_raw(sht4x, &temp, &rh));
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_get_serial(sht4x, &serial));
+    TEST_ASSERT_EQUAL_HEX32(0xdeadbeef, serial);
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_measure_raw(sht4x, &temp, &rh));
+
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_sim_get_stats(PORT, CONFIG_SHT4X_ADDRESS, &stats));
+    TEST_ASSERT_EQUAL(2 + 2, stats.commands);
+    teardown();
+}
+
+TEST_CASE("sht4x_init_static() should measure simulated sensor without heap", "[sht4x]")
+{
+    static sht4x_storage_t storage;
+    uint32_t serial, temp, rh;
+    sht4x_t handle;
+
+    sim_setup(&SIM_CONFIG);
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG,
+                      sht4x_init_static(PORT, CONFIG_SHT4X_ADDRESS, NULL, &handle));
+    TEST_ASSERT_NULL(handle);
+
+    // storage can be reused after sht4x_delete()
+    for (int i = 0; i < 2; ++i) {
+        TEST_ASSERT_EQUAL(ESP_OK,
+                          sht4x_init_static(PORT, CONFIG_SHT4X_ADDRESS, &storage, &handle));
+        TEST_ASSERT_EQUAL_PTR(&storage, (void *)handle);
+        TEST_ASSERT_EQUAL(ESP_OK, sht4x_get_serial(handle, &serial));
+        TEST_ASSERT_EQUAL_HEX32(0xdeadbeef, serial);
+        TEST_ASSERT_EQUAL(ESP_OK, sht4x_measure_raw(handle, &temp, &rh));
+        TEST_ASSERT_EQUAL_HEX32(0x5f16, temp);
+        sht4x_delete(handle);
+    }
+
+#if CONFIG_SHT4X_STATIC_POOL_SIZE
+    sht4x_t handles[CONFIG_SHT4X_STATIC_POOL_SIZE];
+
+    // sim_setup() took one handle from the pool
+    for (int i = 1; i < CONFIG_SHT4X_STATIC_POOL_SIZE; ++i) {
+        TEST_ASSERT_EQUAL(ESP_OK, sht4x_init(PORT, CONFIG_SHT4X_ADDRESS, &handles[i]));
+    }
+
+    TEST_ASSERT_EQUAL(ESP_ERR_NO_MEM, sht4x_init(PORT, CONFIG_SHT4X_ADDRESS, &handle));
+    TEST_ASSERT_NULL(handle);
+
+    for (int i = 1; i < CONFIG_SHT4X_STATIC_POOL_SIZE; ++i) {
+        sht4x_delete(handles[i]);
+    }
+#endif
+    teardown();
+}
+
+TEST_CASE("sht4x_set_filter() should oversample simulated sensor", "[sht4x]")
+{
+    const sht4x_filter_config_t config = {
+        .type = SHT4X_FILTER_MEDIAN, .window = 5, .oversampling = 4};
+    sht4x_sim_stats_t stats;
+    uint32_t temp, rh;
+
+    sim_setup(&SIM_CONFIG);
+
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_set_filter(sht4x, &config));
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_measure_raw(sht4x, &temp, &rh));
+    TEST_ASSERT_EQUAL_HEX32(0x5f16, temp);
+    TEST_ASSERT_EQUAL_HEX32(0x5e35, rh);
+
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_sim_get_stats(PORT, CONFIG_SHT4X_ADDRESS, &stats));
+    TEST_ASSERT_EQUAL(1 + 4, stats.commands);
+    teardown();
+}
+
+TEST_CASE("sht4x_read_burst() should fill evenly spaced samples", "[sht4x]")
+{
+    const sht4x_state_t state = {
+        .magic = SHT4X_STATE_MAGIC, .address = CONFIG_SHT4X_ADDRESS, .oversampling = 1};
+    sht4x_sim_config_t config = SIM_CONFIG;
+    sht4x_sample_t samples[4];
+
+    sim_setup(&SIM_CONFIG);
+
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_read_burst(sht4x, samples, 4, 30000));
+
+    for (int i = 0; i < 4; ++i) {
+        TEST_ASSERT_EQUAL(SHT4X_SAMPLE_OK, samples[i].status);
+        TEST_ASSERT_FALSE(samples[i].heated);
+        TEST_ASSERT_EQUAL_HEX32(0x5f16, samples[i].temperature);
+        TEST_ASSERT_EQUAL_HEX32(0x5e35, samples[i].humidity);
+    }
+
+    TEST_ASSERT_INT32_WITHIN(1000 * portTICK_PERIOD_MS, 3 * 30000,
+                             (int32_t)(samples[3].timestamp - samples[0].timestamp));
+
+    // a period shorter than the conversion time runs late
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_read_burst(sht4x, samples, 2, 1000));
+    TEST_ASSERT_EQUAL(SHT4X_SAMPLE_OK, samples[0].status);
+    TEST_ASSERT_EQUAL(SHT4X_SAMPLE_LATE, samples[1].status);
+    teardown();
+
+    config.crc_error_rate = 1.0f;
+    mock_i2c_Init();
+    sht4x_sim_start(1);
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_sim_add(PORT, CONFIG_SHT4X_ADDRESS, &config));
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_init_from_state(&state, false, &sht4x)); // no serial read
+
+    TEST_ASSERT_NOT_EQUAL(ESP_OK, sht4x_read_burst(sht4x, samples, 2, 0));
+    TEST_ASSERT_EQUAL(SHT4X_SAMPLE_FAILED, samples[1].status);
+    TEST_ASSERT_EQUAL(0, samples[1].temperature);
+    teardown();
+}
+
+TEST_CASE("sht4x_heat_measure_raw() should wait for simulated heater", "[sht4x]")
+{
+    uint32_t temp, rh;
+    int64_t start;
+
+    sim_setup(&SIM_CONFIG);
+
+    start = esp_timer_get_time();
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_heat_measure_raw(sht4x, SHT4X_HEAT_200_100, &temp, &rh));
+    TEST_ASSERT_GREATER_OR_EQUAL(108300, esp_timer_get_time() - start);
+    TEST_ASSERT_GREATER_THAN(0x5f16, temp);
+    TEST_ASSERT_EQUAL_HEX32(0x5e35, rh);
+    teardown();
+}
+
+TEST_CASE("sht4x_measure_raw() should retry simulated CRC and bus errors", "[sht4x]")
+{
+    sht4x_sim_config_t config = SIM_CONFIG;
+    sht4x_sim_stats_t stats;
+    uint32_t temp, rh;
+
+    sim_setup(&config);
+    config.crc_error_rate = 1.0f;
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_sim_add(PORT, 0x45, &config));
+    config.crc_error_rate = 0.0f;
+    config.bus_error_rate = 1.0f;
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_sim_add(PORT, 0x46, &config));
+
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_measure_raw(sht4x, &temp, &rh));
+    sht4x_delete(sht4x);
+
+    // sensor 0x45 answers with bad CRCs only, sensor 0x46 not at all
+    TEST_ASSERT_NOT_EQUAL(ESP_OK, sht4x_init(PORT, 0x45, &sht4x));
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_sim_get_stats(PORT, 0x45, &stats));
+    TEST_ASSERT_EQUAL(CONFIG_SHT4X_NUM_RETRY + 1, stats.crc_errors);
+    sht4x_delete(sht4x);
+
+    TEST_ASSERT_EQUAL(ESP_ERR_TIMEOUT, sht4x_init(PORT, 0x46, &sht4x));
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_sim_get_stats(PORT, 0x46, &stats));
+    TEST_ASSERT_GREATER_THAN(0, stats.bus_errors);
+    teardown();
+}
+
+#if CONFIG_SHT4X_STATS
+TEST_CASE("sht4x_get_stats() should count transactions, errors and latencies", "[sht4x]")
+{
+    sht4x_sim_config_t config = SIM_CONFIG;
+    sht4x_stats_t stats;
+    uint32_t temp, rh;
+
+    sim_setup(&config);
+
+    for (int i = 0; i < 2; ++i) {
+        TEST_ASSERT_EQUAL(ESP_OK, sht4x_measure_raw(sht4x, &temp, &rh));
+    }
+
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_get_stats(sht4x, &stats));
+    TEST_ASSERT_EQUAL(3, stats.transactions); // serial number and measurements
+    TEST_ASSERT_EQUAL(0, stats.crc_errors);
+    TEST_ASSERT_EQUAL(2, stats.latency[4]); // 8.3 ms in [8192, 16384) µs
+
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_reset_stats(sht4x));
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_get_stats(sht4x, &stats));
+    TEST_ASSERT_EQUAL(0, stats.transactions);
+    TEST_ASSERT_EQUAL(0, stats.latency[4]);
+    sht4x_delete(sht4x);
+
+    config.crc_error_rate = 1.0f;
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_sim_add(PORT, 0x45, &config));
+    TEST_ASSERT_EQUAL(ESP_ERR_TIMEOUT, sht4x_init(PORT, 0x45, &sht4x));
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_get_stats(sht4x, &stats));
+    TEST_ASSERT_EQUAL(CONFIG_SHT4X_NUM_RETRY + 1, stats.transactions);
+    TEST_ASSERT_EQUAL(CONFIG_SHT4X_NUM_RETRY + 1, stats.crc_errors);
+    TEST_ASSERT_EQUAL(CONFIG_SHT4X_NUM_RETRY, stats.retries);
+    sht4x_delete(sht4x);
+
+    config.crc_error_rate = 0.0f;
+    config.bus_error_rate = 1.0f;
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_sim_add(PORT, 0x46, &config));
+    TEST_ASSERT_EQUAL(ESP_ERR_TIMEOUT, sht4x_init(PORT, 0x46, &sht4x));
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_get_stats(sht4x, &stats));
+    TEST_ASSERT_EQUAL(1, stats.i2c_timeout);
+    TEST_ASSERT_EQUAL(ESP_ERR_TIMEOUT, stats.i2c_last_error);
+    teardown();
+}
+#endif
+
+TEST_CASE("sht4x_measure_raw_timeout() should return within its budget", "[sht4x]")
+{
+    sht4x_sim_config_t config = SIM_CONFIG;
+    uint32_t temp, rh;
+    int64_t start;
+
+    sim_setup(&config);
+
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_measure_raw_timeout(sht4x, 20000, &temp, &rh));
+    TEST_ASSERT_EQUAL_HEX32(0x5f16, temp);
+
+    // conversion does not fit into budget
+    start = esp_timer_get_time();
+    TEST_ASSERT_EQUAL(SHT4X_ERR_DEADLINE, sht4x_measure_raw_timeout(sht4x, 5000, &temp, &rh));
+    TEST_ASSERT_LESS_THAN(5000, esp_timer_get_time() - start);
+
+    // bus errors are retried with backoff until the budget runs out
+    sht4x_sim_start(1);
+    config.bus_error_rate = 1.0f;
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_sim_add(PORT, CONFIG_SHT4X_ADDRESS, &config));
+
+    start = esp_timer_get_time();
+    TEST_ASSERT_EQUAL(SHT4X_ERR_DEADLINE, sht4x_measure_raw_timeout(sht4x, 50000, &temp, &rh));
+    TEST_ASSERT_GREATER_OR_EQUAL(50000 - 10000, esp_timer_get_time() - start);
+    TEST_ASSERT_LESS_THAN(50000 + 1000 * portTICK_PERIOD_MS, esp_timer_get_time() - start);
+    teardown();
+}
+
+TEST_CASE("sht4x_sched_sweep() should measure simulated sensors in parallel", "[sht4x]")
+{
+    const uint8_t addresses[] = {0x44, 0x45, 0x46};
+    sht4x_sched_result_t results[3];
+    sht4x_sched_t sched;
+    sht4x_t handles[3];
+    int64_t start, ready;
+    uint32_t temp, rh;
+
+    mock_i2c_Init();
+    sht4x_sim_start(1);
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_sched_create(3, &sched));
+
+    for (int i = 0; i < 3; ++i) {
+        TEST_ASSERT_EQUAL(ESP_OK, sht4x_sim_add(PORT, addresses[i], &SIM_CONFIG));
+        TEST_ASSERT_EQUAL(ESP_OK, sht4x_init(PORT, addresses[i], &handles[i]));
+        TEST_ASSERT_EQUAL(ESP_OK, sht4x_sched_add(sched, handles[i]));
+
+        // a sensor added twice would deadlock the sweep
+        if (i < 2) {
+            TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, sht4x_sched_add(sched, handles[0]));
+        }
+    }
+
+    TEST_ASSERT_EQUAL(3, sht4x_sched_count(sched));
+    start = esp_timer_get_time();
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_sched_sweep(sched, results));
+    TEST_ASSERT_LESS_THAN(3 * 8300, esp_timer_get_time() - start); // faster than in turn
+
+    for (int i = 0; i < 3; ++i) {
+        TEST_ASSERT_EQUAL(ESP_OK, results[i].err);
+        TEST_ASSERT_EQUAL_HEX32(0x5f16, results[i].temperature);
+    }
+
+#if CONFIG_SHT4X_STATS
+    // every transfer the sensor saw, counted once
+    for (int i = 0; i < 3; ++i) {
+        sht4x_sim_stats_t sim_stats;
+        sht4x_stats_t stats;
+
+        TEST_ASSERT_EQUAL(ESP_OK, sht4x_get_stats(handles[i], &stats));
+        TEST_ASSERT_EQUAL(ESP_OK, sht4x_sim_get_stats(PORT, addresses[i], &sim_stats));
+        TEST_ASSERT_EQUAL(2, stats.transactions);
+        TEST_ASSERT_EQUAL(sim_stats.commands + sim_stats.reads + sim_stats.nacks,
+                          stats.transfers);
+    }
+#endif
+
+    // a sweep leaves a pending measurement of another user alone
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_start_measure(handles[1], SHT4X_HEAT_NONE, &ready));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, sht4x_sched_sweep(sched, results));
+    TEST_ASSERT_EQUAL(ESP_OK, results[0].err);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, results[1].err);
+    TEST_ASSERT_EQUAL(ESP_OK, results[2].err);
+
+    while (sht4x_fetch_measure_raw(handles[1], &temp, &rh) == ESP_ERR_NOT_FINISHED) {
+        vTaskDelay(1);
+    }
+
+    TEST_ASSERT_EQUAL_HEX32(0x5f16, temp);
+
+    sht4x_sim_stop();
+    mock_i2c_Destroy();
+    sht4x_sched_delete(sched);
+}
+
+TEST_CASE("sht4x_discover() should find simulated sensors at once", "[sht4x]")
+{
+    const i2c_port_t ports[] = {PORT, I2C_NUM_1};
+    sht4x_sim_config_t config = SIM_CONFIG;
+    sht4x_t sensors[3];
+    uint32_t serial;
+    size_t count;
+    int64_t start;
+
+    mock_i2c_Init();
+    sht4x_sim_start(1);
+
+    config.serial = 0x44;
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_sim_add(PORT, 0x44, &config));
+    config.serial = 0x46;
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_sim_add(PORT, 0x46, &config));
+    config.serial = 0x145;
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_sim_add(I2C_NUM_1, 0x45, &config));
+
+    start = esp_timer_get_time();
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_discover(ports, 2, sensors, 3, &count));
+    TEST_ASSERT_LESS_THAN(3 * 11000, esp_timer_get_time() - start); // faster than in turn
+    TEST_ASSERT_EQUAL(3, count);
+
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_get_serial(sensors[0], &serial));
+    TEST_ASSERT_EQUAL_HEX32(0x44, serial);
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_get_serial(sensors[1], &serial));
+    TEST_ASSERT_EQUAL_HEX32(0x46, serial);
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_get_serial(sensors[2], &serial));
+    TEST_ASSERT_EQUAL_HEX32(0x145, serial);
+
+    for (int i = 0; i < 3; ++i) {
+        sht4x_delete(sensors[i]);
+    }
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, sht4x_discover(ports, 2, sensors, 1, &count));
+    TEST_ASSERT_EQUAL(1, count);
+    TEST_ASSERT_EQUAL(ESP_OK, sht4x_get_serial(sensors[0], &serial));
+    TEST_ASSERT_EQUAL_HEX32(0x44, serial);
+    sht4x_delete(sensors[0]);
+
+    sht4x_sim_stop();
+    mock_i2c_Destroy();
+}
 
 void test_sht4x(void)
 {
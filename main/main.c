@@ -5,8 +5,10 @@
  */
 
 #include "sht4x.h"
+#include "sht4x_frame.h"
 
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "driver/i2c.h"
 
 #include "freertos/FreeRTOS.h"
@@ -19,8 +21,76 @@
 
 static const char *TAG = "main";
 
+#if CONFIG_EXAMPLE_OUTPUT_TEXT
+
+static void output(sht4x_t sht4x, uint32_t n, bool heat)
+{
+    float temperature, humidity;
+    esp_err_t ret;
+
+    if (heat) {
+        ret = sht4x_heat_measure(sht4x, SHT4X_HEAT_20_100, &temperature, &humidity);
+    } else {
+        ret = sht4x_measure(sht4x, &temperature, &humidity);
+    }
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "measurement %" PRIu32 " failed: %s", n, esp_err_to_name(ret));
+        return;
+    }
+
+    printf("** %" PRIu32 " %f %f\n", n, temperature, humidity);
+}
+
+#else
+
+#if CONFIG_EXAMPLE_OUTPUT_BINARY_DELTA
+#define DELTA true
+#else
+#define DELTA false
+#endif
+
+static void output(sht4x_t sht4x, uint32_t n, bool heat)
+{
+    static sht4x_frame_encoder_t encoder;
+    uint8_t frame[SHT4X_FRAME_MAX_LEN];
+    uint32_t temperature, humidity;
+    esp_err_t ret;
+
+    if (n == 0) {
+        sht4x_frame_encoder_init(&encoder, 0, DELTA);
+    }
+
+    const int64_t timestamp = esp_timer_get_time();
+
+    if (heat) {
+        ret = sht4x_heat_measure_raw(sht4x, SHT4X_HEAT_20_100, &temperature, &humidity);
+    } else {
+        ret = sht4x_measure_raw(sht4x, &temperature, &humidity);
+    }
+
+    // no frame, rather than one with garbage and a valid CRC
+    if (ret != ESP_OK) {
+        return;
+    }
+
+    const sht4x_sample_t sample = {
+        .timestamp = timestamp, .temperature = temperature, .humidity = humidity,
+        .heated = heat};
+
+    fwrite(frame, 1, sht4x_frame_encode(&encoder, &sample, frame), stdout);
+    fflush(stdout);
+}
+
+#endif
+
 void app_main(void)
 {
+#if !CONFIG_EXAMPLE_OUTPUT_TEXT
+    // log messages would share the console with the frames
+    esp_log_level_set("*", ESP_LOG_NONE);
+#endif
+
     ESP_LOGI(TAG, "version 0.1.0");
 
     const i2c_config_t config = {.mode = I2C_MODE_MASTER,
@@ -33,18 +103,14 @@ void app_main(void)
     sht4x_t sht4x;
     ESP_ERROR_CHECK(sht4x_init(PORT, CONFIG_SHT4X_ADDRESS, &sht4x));
 
-    float temperature, humidity;
     uint32_t n = 0;
 
     while (1) {
         if (n == 3) {
             ESP_LOGI(TAG, "heating....");
-            sht4x_heat_measure(sht4x, SHT4X_HEAT_20_100, &temperature, &humidity);
-        } else {
-            sht4x_measure(sht4x, &temperature, &humidity);
         }
 
-        printf("** %" PRIu32 " %f %f\n", n, temperature, humidity);
+        output(sht4x, n, n == 3);
         vTaskDelay(5000 / portTICK_PERIOD_MS);
         ++n;
     }
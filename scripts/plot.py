@@ -4,64 +4,285 @@
 import argparse
 import matplotlib.pyplot as plt
 import numpy as np
+import queue
 import serial
 import serial.tools.list_ports as list_ports
+import struct
 import sys
+import threading
+import time
 
+FRAME_SYNC = 0xA5
+FRAME_DELTA = 0x01
+FRAME_KEY_LEN = 12
+FRAME_DELTA_LEN = 8
 
-def plot(monitor, prefix):
-    """Plot data from serial monitor."""
 
-    fig = plt.figure()
-    ax1 = fig.add_subplot(2, 1, 1)
-    ax2 = fig.add_subplot(2, 1, 2)
+def crc8(data):
+    """CRC-8 of SHT4x (polynomial 0x31, initial value 0xff)."""
+
+    crc = 0xFF
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x31) & 0xFF if crc & 0x80 else crc << 1
+    return crc
+
+
+def raw_to_temperature(raw):
+    return -45 + 175 * raw / 65535
+
+
+def raw_to_relative_humidity(raw):
+    return min(max(-6 + 125 * raw / 65535, 0), 100)
+
+
+class Decoder:
+    """Decode binary frames (see sht4x_frame.h) and text lines.
+
+    Text lines starting with prefix are legacy measurements
+    "<iteration> <temperature> <humidity>"; other text is passed through.
+    """
+
+    def __init__(self, prefix):
+        self.prefix = prefix.encode()
+        self.buffer = bytearray()
+        self.previous = {}  # sensor id -> (timestamp, temperature, humidity)
+
+    def feed(self, data):
+        """Decode data; yield (sensor, x, temperature, humidity) or str."""
+
+        self.buffer += data
+
+        while self.buffer:
+            if self.buffer[0] == FRAME_SYNC:
+                if len(self.buffer) < 2:
+                    return
+                delta = self.buffer[1] == FRAME_DELTA
+                n = FRAME_DELTA_LEN if delta else FRAME_KEY_LEN
+                if len(self.buffer) < n:
+                    return
+                frame = bytes(self.buffer[:n])
+                if self.buffer[1] & ~FRAME_DELTA or crc8(frame[1:-1]) != frame[-1]:
+                    del self.buffer[0]  # not a frame; resynchronize
+                    continue
+                del self.buffer[:n]
+                sample = self.decode(frame, delta)
+                if sample:
+                    yield sample
+                continue
+
+            end = self.buffer.find(b"\n")
+            sync = self.buffer.find(FRAME_SYNC)
+            if sync >= 0 and (end < 0 or sync < end):
+                end = sync - 1  # text up to start of frame
+            elif end < 0:
+                return
+            line = bytes(self.buffer[: end + 1])
+            del self.buffer[: end + 1]
+
+            if line.startswith(self.prefix):
+                try:
+                    row = [float(x) for x in line[len(self.prefix) :].split()]
+                    yield (0, row[0], row[1], row[2])
+                    continue
+                except (ValueError, IndexError):
+                    pass
+            yield line.decode(errors="replace")
+
+    def decode(self, frame, delta):
+        sensor = frame[2]
+        if delta:
+            if sensor not in self.previous:
+                return None  # wait for key frame
+            dt, dtemp, drh = struct.unpack_from("<Hbb", frame, 3)
+            t, temp, rh = self.previous[sensor]
+            t, temp, rh = (t + dt) & 0xFFFFFFFF, temp + dtemp, rh + drh
+        else:
+            t, temp, rh = struct.unpack_from("<IHH", frame, 3)
+        self.previous[sensor] = (t, temp, rh)
+        return (
+            sensor,
+            t / 1000,
+            raw_to_temperature(temp),
+            raw_to_relative_humidity(rh),
+        )
+
+
+class Ring:
+    """Fixed-size ring buffer with running sum."""
+
+    def __init__(self, capacity):
+        self.data = np.zeros(capacity)
+        self.index = 0
+        self.count = 0
+        self.sum = 0.0
+
+    def push(self, value):
+        if self.count == len(self.data):
+            self.sum -= self.data[self.index]
+        else:
+            self.count += 1
+        self.data[self.index] = value
+        self.sum += value
+        self.index = (self.index + 1) % len(self.data)
+        if self.index == 0:
+            self.sum = self.data[: self.count].sum()  # bound rounding drift
+
+    def mean(self):
+        return self.sum / self.count if self.count else np.nan
 
-    x = []
-    temp = []
-    humidity = []
+    def values(self):
+        """Return values from oldest to newest."""
 
-    n = len(prefix)
+        if self.count < len(self.data):
+            return self.data[: self.count]
+        return np.concatenate((self.data[self.index :], self.data[: self.index]))
+
+
+class Sensor:
+    """Window of samples of one sensor and its plot lines."""
+
+    def __init__(self, window, axes, name):
+        self.x = Ring(window)
+        self.y = [Ring(window) for _ in axes]
+        self.lines = [ax.plot([], [], "-o", label=name, animated=True)[0] for ax in axes]
+
+    def push(self, x, *y):
+        self.x.push(x)
+        for ring, value in zip(self.y, y):
+            ring.push(value)
+
+    def update(self):
+        x = self.x.values()
+        for line, ring in zip(self.lines, self.y):
+            line.set_data(x, ring.values())
+
+
+def read(monitor, prefix, samples):
+    """Read and decode serial data; put samples in queue."""
+
+    decoder = Decoder(prefix)
 
     while 1:
-        line = monitor.read_until().decode()
-        print(line, end="")
+        for item in decoder.feed(monitor.read(max(monitor.in_waiting, 1))):
+            if isinstance(item, str):
+                print(item, end="")
+            else:
+                print("{} {} {:.2f} {:.2f}".format(*item))
+                samples.put(item)
+
+
+def plot(monitor, prefix, window, interval):
+    """Plot data from serial monitor.
+
+    Samples are read on a separate thread. The plot is redrawn every
+    interval seconds by blitting the lines on a cached background; the
+    background is only redrawn when the axis limits change.
+    """
+
+    samples = queue.SimpleQueue()
+    threading.Thread(target=read, args=(monitor, prefix, samples), daemon=True).start()
+
+    fig = plt.figure()
+    axes = [fig.add_subplot(2, 1, 1), fig.add_subplot(2, 1, 2)]
+    axes[0].set_ylabel("Temperature (°C)")
+    axes[1].set_ylabel("Relative Humidity")
+    axes[1].set_xlabel("Iteration / Time (s)")
+    units = ["°C", "%"]
+    means = [
+        ax.text(0.01, 0.95, "", transform=ax.transAxes, va="top", animated=True)
+        for ax in axes
+    ]
+
+    sensors = {}
+    background = None
+
+    def draw_animated():
+        for s in sensors.values():
+            for line, ax in zip(s.lines, axes):
+                ax.draw_artist(line)
+        for text, ax in zip(means, axes):
+            ax.draw_artist(text)
+
+    def on_draw(event):
+        """Cache background after full redraws (e.g., resize)."""
+
+        nonlocal background
+        background = fig.canvas.copy_from_bbox(fig.bbox)
+        draw_animated()
+
+    def rescale():
+        """Set axis limits that contain the data; return True if changed."""
+
+        x = np.concatenate([s.x.values() for s in sensors.values()])
+        x0, x1 = axes[0].get_xlim()
+        changed = x.max() > x1 or x.min() > x0 + (x1 - x0) / 2
+        if changed:
+            span = max(x.max() - x.min(), 1)
+            for ax in axes:
+                ax.set_xlim(x.min(), x.max() + span / 4)
 
-        if line[:n] != prefix:
-            continue
+        for i, ax in enumerate(axes):
+            y = np.concatenate([s.y[i].values() for s in sensors.values()])
+            y0, y1 = ax.get_ylim()
+            margin = max(y.max() - y.min(), 1) / 10
+            if y.min() < y0 or y.max() > y1 or 20 * margin < y1 - y0:
+                ax.set_ylim(y.min() - margin, y.max() + margin)
+                changed = True
 
-        row = [float(x) for x in line[n:].split()]
-        x.append(row[0])
-        temp.append(row[1])
-        humidity.append(row[2])
+        return changed
 
-        x = x[-40:]
-        temp = temp[-40:]
-        humidity = humidity[-40:]
+    fig.canvas.mpl_connect("draw_event", on_draw)
+    plt.show(block=False)
+    fig.canvas.draw()
 
-        ax1.clear()
-        ax1.plot(x, temp, "-o")
-        ax1.set_xlabel("Iteration")
-        ax1.set_ylabel("Temperature (°C)")
-        ax1.legend(["mean = {:.1f} °C".format(np.mean(temp))])
+    while plt.fignum_exists(fig.number):
+        new = False
+        try:
+            while 1:
+                sensor, x, temp, humidity = samples.get_nowait()
+                if sensor not in sensors:
+                    sensors[sensor] = Sensor(window, axes, "sensor {}".format(sensor))
+                    for ax in axes:
+                        ax.legend(loc="upper right")
+                    background = None  # redraw legend
+                sensors[sensor].push(x, temp, humidity)
+                new = True
+        except queue.Empty:
+            pass
 
-        ax2.clear()
-        ax2.plot(x, humidity, "-o")
-        ax2.set_xlabel("Iteration")
-        ax2.set_ylabel("Relative Humidity")
-        ax2.legend(["mean = {:.1f}%".format(np.mean(humidity))])
-        plt.pause(0.5)
+        if new:
+            for s in sensors.values():
+                s.update()
+            for i, text in enumerate(means):
+                text.set_text(
+                    "\n".join(
+                        "sensor {}: mean = {:.1f} {}".format(k, s.y[i].mean(), units[i])
+                        for k, s in sorted(sensors.items())
+                    )
+                )
+            if rescale() or background is None:
+                fig.canvas.draw()
+            else:
+                fig.canvas.restore_region(background)
+                draw_animated()
+                fig.canvas.blit(fig.bbox)
 
-    plt.show()
+        fig.canvas.flush_events()
+        time.sleep(interval)
 
 
 if __name__ == "__main__":
     p = argparse.ArgumentParser(prog="plot.py", description=__doc__)
     p.add_argument("-b", dest="baud", type=int, default=115200, help="baud rate")
     p.add_argument("-f", dest="prefix", type=str, default="**", help="filter prefix")
+    p.add_argument("-i", dest="interval", type=float, default=0.05, help="redraw interval (s)")
+    p.add_argument("-n", dest="window", type=int, default=40, help="samples per sensor")
     p.add_argument("-p", dest="port", type=str, help="serial port")
     args = p.parse_args()
 
     port = args.port if args.port else list_ports.comports()[0].device
 
     with serial.Serial(port, args.baud, timeout=5) as monitor:
-        plot(monitor, args.prefix)
+        plot(monitor, args.prefix, args.window, args.interval)